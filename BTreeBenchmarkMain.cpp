@@ -0,0 +1,1092 @@
+/*
+@filename: BTree - Benchmark Main
+
+@author: Doc Holloway
+@date: 10/18/2026
+
+@description: This benchmark main runs reproducible workloads against the B-Tree and against std::set and std::map as baselines. Every run
+is driven by a seed, so two runs with the same arguments see the same keys in the same order. Workloads cover sequential, reverse and
+random loads, uniform and Zipfian point reads, point reads in ascending key order and in short Zipfian steps from the previous key, YCSB
+style read/update/insert/scan mixes, where the scans read up to 100 keys in order, reads that mostly miss, and random deletes, over int
+keys and URL string keys. Each result reports throughput, latency percentiles, bytes per key and tree height, as a table on screen and
+optionally as JSON for regression tracking. A separate mode times join, splitAt and the set operations against the per-key loops they
+replace.
+
+Usage:
+	BTreeBench [--keys N] [--ops N] [--seed N] [--skew X] [--structures list] [--json file] [--stats] [--set-algebra]
+	--keys        Number of keys loaded before the read and mix workloads (default 1000000, up to 100000000).
+	--ops         Number of operations in each read and mix workload (default equal to --keys).
+	--seed        Seed for every generator (default 42).
+	--skew        Zipfian theta of read-zipfian and the YCSB mixes (default 0.99, must not be 1).
+	--structures  Comma separated subset of btree,btree-finger,btree-lazy,btree-incremental,btree-buffered,btree-filter,
+	              btree-hugepage,btree-cache,set,map (default all).
+	--json        File to write the results to as a JSON array.
+	--stats       Attach a BTree::stats snapshot to every B-Tree result, and the process wide hot path counters to every result.
+	              Build with -DBTREE_STATS to compile the counters in; they are reset at the start of each workload.
+	--set-algebra Instead of the suite, time join, splitAt, unionWith, intersectWith and differenceWith on int key trees built from
+	              --keys keys, each followed by the per-key insert, remove and search loop that does the same job.
+
+Compilation instructions:
+
+Using Ubuntu 22.04:
+	g++ -O2 BTreeBenchmarkMain.cpp -o BTreeBench
+	./BTreeBench --keys 1000000 --json results.json
+Using Visual Studio:
+	Build BTreeBenchmarkMain.cpp in Release in place of the driver main, and run without the debugger
+*/
+
+#include "BTreeTemplateClass.h"
+#include <chrono>
+#include <set>
+#include <fstream>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <functional>
+#include <map>
+#include <malloc.h>
+
+/*
+Heap bytes reports the bytes of heap in use, so that bytes per key can be measured the same way for the B-Tree and for std::set and
+std::map. With glibc it reads the allocator's own totals through mallinfo2, which count every chunk in use including its header and
+rounding, so no allocation function has to be replaced. Under Visual C++, global allocation hooks keep the same total, measuring each block
+with _msize, and operator delete hands free the pointer that malloc returned to operator new. Elsewhere it reads 0.
+*/
+#if defined(__GLIBC__)
+size_t heapBytes()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+#elif defined(_MSC_VER)
+static size_t liveBytes = 0;
+
+size_t heapBytes()
+{
+	return liveBytes;
+}
+
+void* operator new(size_t size)
+{
+	void* block = malloc(size == 0 ? 1 : size);
+	if (block == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	liveBytes += _msize(block);
+	return block;
+}
+
+void operator delete(void* block) noexcept
+{
+	if (block == nullptr)
+	{
+		return;
+	}
+	liveBytes -= _msize(block);
+	free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+#else
+size_t heapBytes()
+{
+	return 0;
+}
+#endif
+
+/*
+Used bytes adds the blocks handed out by the huge page arenas of btree-hugepage, which are mapped directly and never reach the heap.
+*/
+size_t usedBytes()
+{
+	return heapBytes() + BTreeArena::hot().live() + BTreeArena::cold().live();
+}
+
+/*
+Compare function used as pointer parameter in tree construction. Function returns -1, 0, or 1 based on the comparison
+of two items.
+
+@param[in]: Two TYPE items to be compared.
+@return: -1,0, or 1 based on the comparison of the inputs.
+*/
+template <typename TYPE>
+int compare(const TYPE& item1, const TYPE& item2)
+{
+	if (item1 < item2)
+		return -1;
+	if (item1 == item2)
+		return 0;
+	return 1;
+}
+
+/*
+Hash function used as pointer parameter for the membership filter of btree-filter.
+
+@param[in]: A TYPE item to hash.
+@return: The std::hash of the item.
+*/
+template <typename TYPE>
+size_t hashKey(const TYPE& item)
+{
+	return hash<TYPE>()(item);
+}
+
+/*
+Latency histogram records operation times in log-linear buckets: every power of two is split into 16 linear sub-buckets, which keeps
+percentiles within about 6% while using constant memory, even for 100M operations.
+
+@param[in]: Latencies in nanoseconds through record.
+@return: Percentiles and the maximum in nanoseconds.
+*/
+class LatencyHistogram
+{
+	vector<long long> buckets;
+	long long total;
+	long long maxValue;
+
+	static int bucketOf(long long value)
+	{
+		if (value < 16)
+		{
+			return static_cast<int>(value);
+		}
+		int msb = 0;
+		while ((value >> (msb + 1)) != 0)
+		{
+			msb++;
+		}
+		return 16 + (msb - 4) * 16 + static_cast<int>((value >> (msb - 4)) & 15);
+	}
+
+	static long long lowerBoundOf(int bucket)
+	{
+		if (bucket < 16)
+		{
+			return bucket;
+		}
+		int msb = (bucket - 16) / 16 + 4;
+		return static_cast<long long>(16 + (bucket - 16) % 16) << (msb - 4);
+	}
+
+public:
+	LatencyHistogram() : buckets(16 + 60 * 16, 0), total(0), maxValue(0) {}
+
+	void record(long long nanoseconds)
+	{
+		if (nanoseconds < 0)
+		{
+			nanoseconds = 0;
+		}
+		buckets[bucketOf(nanoseconds)]++;
+		total++;
+		if (nanoseconds > maxValue)
+		{
+			maxValue = nanoseconds;
+		}
+	}
+
+	long long percentile(double fraction)
+	{
+		long long target = static_cast<long long>(fraction * total);
+		long long seen = 0;
+		for (size_t i = 0; i < buckets.size(); i++)
+		{
+			seen += buckets[i];
+			if (seen > target)
+			{
+				return lowerBoundOf(i);
+			}
+		}
+		return maxValue;
+	}
+
+	long long maximum()
+	{
+		return maxValue;
+	}
+};
+
+/*
+Zipfian generator draws ranks in [0, n) with the given skew (YCSB uses theta 0.99), following Gray et al. "Quickly Generating Billion-Record
+Synthetic Databases". Ranks are scrambled through a hash so that the hot keys are spread across the key space instead of clustering at
+the low end. An unscrambled generator returns the rank itself, which read-zipf-local uses as a distance between consecutive keys.
+
+@param[in]: The number of items, the skew, whether to scramble, and the random engine to draw from.
+@return: An index into the loaded keys.
+*/
+class ZipfianGenerator
+{
+	long long items;
+	double theta;
+	double zetan;
+	double alpha;
+	double eta;
+	bool scrambled;
+
+public:
+	ZipfianGenerator(long long n, double skew, bool scramble = true) : items(n), theta(skew), scrambled(scramble)
+	{
+		zetan = 0;
+		for (long long i = 1; i <= n; i++)
+		{
+			zetan += 1.0 / pow(static_cast<double>(i), theta);
+		}
+		double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+		alpha = 1.0 / (1.0 - theta);
+		eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+	}
+
+	long long next(mt19937_64& engine)
+	{
+		double u = uniform_real_distribution<double>(0.0, 1.0)(engine);
+		double uz = u * zetan;
+		long long rank;
+		if (uz < 1.0)
+		{
+			rank = 0;
+		}
+		else if (uz < 1.0 + pow(0.5, theta))
+		{
+			rank = 1;
+		}
+		else
+		{
+			rank = static_cast<long long>(items * pow(eta * u - eta + 1.0, alpha));
+		}
+		if (rank >= items)
+		{
+			rank = items - 1;
+		}
+		if (!scrambled)
+		{
+			return rank;
+		}
+
+		unsigned long long hash = 14695981039346656037ULL;
+		for (int i = 0; i < 8; i++)
+		{
+			hash ^= (static_cast<unsigned long long>(rank) >> (i * 8)) & 0xff;
+			hash *= 1099511628211ULL;
+		}
+		return static_cast<long long>(hash % static_cast<unsigned long long>(items));
+	}
+};
+
+/*
+Key makers turn an index into a key. Int keys are spaced by 2, so odd values are known misses and new keys can be appended past the end.
+URL keys are built from the index and a seeded mix of hosts and paths, and stay in index order only by accident. Miss keys are never
+loaded: odd ints, and URLs with a query string.
+*/
+int makeKey(long long index, int*)
+{
+	return static_cast<int>(index * 2);
+}
+
+string makeKey(long long index, string*)
+{
+	unsigned long long mixed = static_cast<unsigned long long>(index) * 0x9E3779B97F4A7C15ULL;
+	stringstream sstream;
+	sstream << "https://www.site" << (mixed >> 54) << ".example.com/articles/" << ((mixed >> 20) & 0xffff) << "/" << index << ".html";
+	return sstream.str();
+}
+
+int makeMissKey(long long index, int*)
+{
+	return static_cast<int>(index * 2 + 1);
+}
+
+string makeMissKey(long long index, string*)
+{
+	return makeKey(index, static_cast<string*>(nullptr)) + "?missing";
+}
+
+//In btree-buffered mode the write buffer holds this many messages before each write starts applying one leaf's worth of them.
+const int writeBufferBatch = 16;
+//In btree-filter the membership filter gets this many bits per key at full load.
+const int filterBitsPerKey = 10;
+//In btree-cache the lookup cache gets this many entries, 64KB at 16 bytes each.
+const int lookupCacheSlots = 4096;
+//Read-zipf-local steps this many keys at most between consecutive reads, with short steps the most likely.
+const long long localWindow = 1024;
+//A YCSB-E scan reads a uniform number of keys from 1 up to this many.
+const int maxScanLength = 100;
+
+/*
+Targets wrap each structure under test behind the same small interface, so every workload runs the same code against the B-Tree in each
+of its modes and against std::set and std::map, the latter with an int value per key. Height is 0 for the standard containers, which have
+no comparable notion of levels. Writes held back by btree-buffered are applied by finish, which the load and delete workloads time along
+with their operations. Lookups go through contains, or containsNear for btree-finger, so a miss costs no exception, btree-filter can rule
+it out, and a btree-cache hit skips the descent. Scans copy the keys they read into a vector each target reuses.
+*/
+template <typename KEY>
+class BTreeTarget
+{
+	BTree<KEY> tree;
+	bool useFinger;
+	bool lazy;
+	vector<KEY> scanned;
+
+public:
+	BTreeTarget(const string& mode) : tree(compare<KEY>), useFinger(mode == "btree-finger"), lazy(mode == "btree-lazy")
+	{
+		if (lazy)
+		{
+			tree.setLazyRebalance(true);
+		}
+		if (mode == "btree-incremental")
+		{
+			tree.setIncrementalRestructure(1);
+		}
+		if (mode == "btree-buffered")
+		{
+			tree.setWriteBuffer(writeBufferBatch);
+		}
+		if (mode == "btree-filter")
+		{
+			tree.setMembershipFilter(filterBitsPerKey, hashKey<KEY>);
+		}
+		if (mode == "btree-hugepage")
+		{
+			tree.setHugePageNodes(true);
+		}
+		if (mode == "btree-cache")
+		{
+			tree.setLookupCache(lookupCacheSlots, hashKey<KEY>);
+		}
+	}
+
+	void insert(const KEY& key)
+	{
+		if (useFinger) { tree.insertNear(key); } else { tree.insert(key); }
+	}
+
+	void remove(const KEY& key)
+	{
+		if (useFinger) { tree.removeNear(key); } else { tree.remove(key); }
+	}
+
+	//Idle stands in for the gap between requests, where btree-lazy compacts the nodes its removes left dirty. It returns how many dirty
+	//nodes it found, so idle calls with nothing to do can be told apart.
+	int idle()
+	{
+		int dirty = tree.dirtyCount();
+		if (lazy && dirty > 0)
+		{
+			tree.compact();
+		}
+		return lazy ? dirty : 0;
+	}
+
+	bool find(const KEY& key)
+	{
+		return useFinger ? tree.containsNear(key) : tree.contains(key);
+	}
+
+	bool mayContain(const KEY& key)
+	{
+		return tree.mayContain(key);
+	}
+
+	long long filterBytes()
+	{
+		return tree.stats().filterBytes;
+	}
+
+	int scan(const KEY& low, int limit)
+	{
+		return tree.scan(low, limit, scanned);
+	}
+
+	//Finish applies any buffered writes, and is timed as part of the load and delete workloads.
+	void finish()
+	{
+		tree.flushWrites();
+	}
+
+	int height()
+	{
+		return tree.height();
+	}
+
+	string statsJson()
+	{
+		return tree.stats().toJson();
+	}
+};
+
+template <typename KEY, typename CONTAINER>
+class StdTarget
+{
+	CONTAINER keys;
+	vector<KEY> scanned;
+
+	static void put(set<KEY>& container, const KEY& key)
+	{
+		container.insert(key);
+	}
+
+	static void put(map<KEY, int>& container, const KEY& key)
+	{
+		container.insert(make_pair(key, 0));
+	}
+
+	static const KEY& keyOf(const KEY& key)
+	{
+		return key;
+	}
+
+	static const KEY& keyOf(const pair<const KEY, int>& entry)
+	{
+		return entry.first;
+	}
+
+public:
+	StdTarget(const string&) {}
+
+	void insert(const KEY& key)
+	{
+		put(keys, key);
+	}
+
+	void remove(const KEY& key)
+	{
+		keys.erase(key);
+	}
+
+	bool find(const KEY& key)
+	{
+		return keys.find(key) != keys.end();
+	}
+
+	bool mayContain(const KEY&)
+	{
+		return true;
+	}
+
+	long long filterBytes()
+	{
+		return 0;
+	}
+
+	int scan(const KEY& low, int limit)
+	{
+		scanned.clear();
+		for (typename CONTAINER::iterator it = keys.lower_bound(low); it != keys.end() && static_cast<int>(scanned.size()) < limit; ++it)
+		{
+			scanned.push_back(keyOf(*it));
+		}
+		return static_cast<int>(scanned.size());
+	}
+
+	void finish()
+	{
+	}
+
+	int idle()
+	{
+		return 0;
+	}
+
+	int height()
+	{
+		return 0;
+	}
+
+	string statsJson()
+	{
+		return "";
+	}
+};
+
+/*
+Idle work collects the idle calls a workload makes every idleInterval operations. They run outside the operation timings and outside the
+workload's elapsed time, and are reported as their own row when any of them found work, so the cost of compaction shows up on its own
+instead of inside the latency of the remove that happened to trigger it.
+*/
+struct IdleWork
+{
+	LatencyHistogram histogram;
+	long long calls;
+	long long elapsed;
+	long long found;
+};
+
+//Workloads that remove keys give the structure an idle call after every idleInterval operations.
+const long long idleInterval = 1024;
+
+/*
+Result holds one line of the report. Results are printed as they finish and collected for the JSON file at the end.
+*/
+struct Result
+{
+	string structure;
+	string keyType;
+	string workload;
+	long long keys;
+	long long operations;
+	double opsPerSecond;
+	long long p50;
+	long long p99;
+	long long p999;
+	long long maxLatency;
+	double bytesPerKey;
+	int height;
+	string treeStats;
+	string counters;
+};
+
+vector<Result> results;
+//Read results are added into sink so the compiler cannot drop the lookups.
+volatile long long sink = 0;
+bool collectStats = false;
+double zipfSkew = 0.99;
+
+long long nowNanoseconds()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void report(const string& structure, const string& keyType, const string& workload, long long keys, long long operations,
+	long long elapsed, LatencyHistogram& histogram, double bytesPerKey, int height, const string& treeStats)
+{
+	Result result = { structure, keyType, workload, keys, operations, operations / (elapsed / 1e9), histogram.percentile(0.5),
+		histogram.percentile(0.99), histogram.percentile(0.999), histogram.maximum(), bytesPerKey, height, treeStats,
+		collectStats ? counterSnapshot().toJson() : "" };
+	results.push_back(result);
+
+	printf("%-18s %-6s %-16s %12.0f ops/s  p50 %6lld  p99 %7lld  p999 %8lld  max %9lld ns  %6.1f B/key  h=%d\n",
+		structure.c_str(), keyType.c_str(), workload.c_str(), result.opsPerSecond, result.p50, result.p99, result.p999,
+		result.maxLatency, bytesPerKey, height);
+	fflush(stdout);
+}
+
+/*
+Run idle makes one timed idle call on target, and adds it to idle.
+
+@param[in]: The structure under test, and the idle work of the current workload.
+@return: Nothing. idle holds the call.
+*/
+template <typename TARGET>
+void runIdle(TARGET* target, IdleWork& idle)
+{
+	long long idleStart = nowNanoseconds();
+	idle.found += target->idle();
+	long long idleTime = nowNanoseconds() - idleStart;
+	idle.histogram.record(idleTime);
+	idle.elapsed += idleTime;
+	idle.calls++;
+}
+
+/*
+Report idle adds the row for a workload's idle calls, named after the workload with -idle appended, if any of them found work.
+
+@param[in]: The same fields as report, with the idle work in place of the operation counts and timings.
+@return: Nothing. The row is printed and appended to results.
+*/
+void reportIdle(const string& structure, const string& keyType, const string& workload, long long keys, IdleWork& idle,
+	double bytesPerKey, int height, const string& treeStats)
+{
+	if (idle.found > 0)
+	{
+		report(structure, keyType, workload + "-idle", keys, idle.calls, idle.elapsed, idle.histogram, bytesPerKey, height, treeStats);
+	}
+}
+
+/*
+Run suite loads one structure and runs every workload on it in a fixed order: a sequential and a reverse load, each on a scratch copy, then
+a random load, point reads (uniform, Zipfian, and on int keys sorted and Zipf-local), the YCSB style mixes, uniform reads of which 90%
+miss, and finally deleting every key in random order. For a structure with a membership filter, the miss workload is followed by a line
+with the filter's false positive rate over its misses and its size. The mixes and the delete make an idle call every idleInterval
+operations, outside their timings, which is where btree-lazy compacts. All randomness comes from generators seeded by seed, so the key
+order and operation mix are identical between runs and between structures.
+
+@param[in]: The structure name, the key type name, how many keys to load, how many operations per workload, and the seed.
+@return: Nothing. Results are printed and appended to results.
+*/
+template <typename TARGET, typename KEY>
+void runSuite(const string& structure, const string& keyType, long long keyCount, long long opCount, unsigned seed)
+{
+	KEY* tag = nullptr;
+	vector<long long> order(keyCount);
+	for (long long i = 0; i < keyCount; i++)
+	{
+		order[i] = i;
+	}
+
+	const char* loadNames[] = { "load-sequential", "load-reverse" };
+	for (int pass = 0; pass < 2; pass++)
+	{
+		LatencyHistogram histogram;
+		size_t bytesBefore = usedBytes();
+		TARGET* target = new TARGET(structure);
+		resetCounters();
+		long long start = nowNanoseconds();
+		for (long long i = 0; i < keyCount; i++)
+		{
+			KEY key = makeKey(pass == 0 ? i : keyCount - 1 - i, tag);
+			long long opStart = nowNanoseconds();
+			target->insert(key);
+			histogram.record(nowNanoseconds() - opStart);
+		}
+		target->finish();
+		long long elapsed = nowNanoseconds() - start;
+		report(structure, keyType, loadNames[pass], keyCount, keyCount, elapsed, histogram,
+			static_cast<double>(usedBytes() - bytesBefore) / keyCount, target->height(),
+			collectStats ? target->statsJson() : "");
+		delete target;
+	}
+
+	mt19937_64 engine(seed);
+	shuffle(order.begin(), order.end(), engine);
+
+	size_t bytesBefore = usedBytes();
+	TARGET* target = new TARGET(structure);
+	double bytesPerKey = 0;
+	{
+		LatencyHistogram histogram;
+		resetCounters();
+		long long start = nowNanoseconds();
+		for (long long i = 0; i < keyCount; i++)
+		{
+			KEY key = makeKey(order[i], tag);
+			long long opStart = nowNanoseconds();
+			target->insert(key);
+			histogram.record(nowNanoseconds() - opStart);
+		}
+		target->finish();
+		long long elapsed = nowNanoseconds() - start;
+		bytesPerKey = static_cast<double>(usedBytes() - bytesBefore) / keyCount;
+		report(structure, keyType, "load-random", keyCount, keyCount, elapsed, histogram, bytesPerKey, target->height(),
+			collectStats ? target->statsJson() : "");
+	}
+
+	ZipfianGenerator zipf(keyCount, zipfSkew);
+	ZipfianGenerator localZipf(min(keyCount, localWindow), zipfSkew, false);
+
+	//Workload codes: 'u' uniform reads, 'z' Zipfian reads, 's' reads in ascending key order, 'l' Zipf-local reads, 'a' YCSB-A,
+	//'b' YCSB-B, 'd' YCSB-D, 'e' YCSB-E, 'm' 90% miss reads.
+	const char* names[] = { "read-uniform", "read-zipfian", "read-sorted", "read-zipf-local", "ycsb-a", "ycsb-b", "ycsb-d", "ycsb-e",
+		"read-miss90" };
+	const char codes[] = { 'u', 'z', 's', 'l', 'a', 'b', 'd', 'e', 'm' };
+	long long nextIndex = keyCount;
+	long long localIndex = 0;
+
+	for (int w = 0; w < 9; w++)
+	{
+		//The locality streams walk the index, which is key order only for int keys.
+		if ((codes[w] == 's' || codes[w] == 'l') && keyType != "int")
+		{
+			continue;
+		}
+
+		mt19937_64 opEngine(seed + w + 1);
+		vector<long long> picks(opCount);
+		vector<int> kinds(opCount);
+		vector<int> scanLengths(codes[w] == 'e' ? opCount : 0);
+		for (long long i = 0; i < opCount; i++)
+		{
+			int roll = static_cast<int>(opEngine() % 100);
+			switch (codes[w])
+			{
+				case 'u':
+					picks[i] = opEngine() % keyCount;
+					kinds[i] = 0;
+					break;
+				case 'z':
+					picks[i] = zipf.next(opEngine);
+					kinds[i] = 0;
+					break;
+				case 's':
+					picks[i] = i * keyCount / opCount;
+					kinds[i] = 0;
+					break;
+				case 'l':
+					localIndex += roll < 50 ? -localZipf.next(opEngine) : localZipf.next(opEngine);
+					localIndex = (localIndex % keyCount + keyCount) % keyCount;
+					picks[i] = localIndex;
+					kinds[i] = 0;
+					break;
+				case 'a':
+					picks[i] = zipf.next(opEngine);
+					kinds[i] = roll < 50 ? 0 : 1;
+					break;
+				case 'b':
+					picks[i] = zipf.next(opEngine);
+					kinds[i] = roll < 95 ? 0 : 1;
+					break;
+				case 'd':
+					kinds[i] = roll < 95 ? 0 : 2;
+					picks[i] = kinds[i] == 2 ? nextIndex++ : nextIndex - 1 - (zipf.next(opEngine) % keyCount);
+					break;
+				case 'e':
+					kinds[i] = roll < 95 ? 3 : 2;
+					picks[i] = kinds[i] == 2 ? nextIndex++ : zipf.next(opEngine);
+					scanLengths[i] = 1 + static_cast<int>(opEngine() % maxScanLength);
+					break;
+				case 'm':
+					picks[i] = opEngine() % keyCount;
+					kinds[i] = roll < 90 ? 4 : 0;
+					break;
+			}
+		}
+
+		LatencyHistogram histogram;
+		IdleWork idle = { LatencyHistogram(), 0, 0, 0 };
+		long long found = 0;
+		resetCounters();
+		long long start = nowNanoseconds();
+		for (long long i = 0; i < opCount; i++)
+		{
+			KEY key = kinds[i] == 4 ? makeMissKey(picks[i], tag) : makeKey(picks[i], tag);
+			long long opStart = nowNanoseconds();
+			switch (kinds[i])
+			{
+				case 0:
+				case 4:
+					found += target->find(key);
+					break;
+				case 1:
+					target->remove(key);
+					target->insert(key);
+					break;
+				case 2:
+					target->insert(key);
+					break;
+				case 3:
+					found += target->scan(key, scanLengths[i]);
+					break;
+			}
+			histogram.record(nowNanoseconds() - opStart);
+			if ((i + 1) % idleInterval == 0)
+			{
+				runIdle(target, idle);
+			}
+		}
+		long long elapsed = nowNanoseconds() - start - idle.elapsed;
+		sink = sink + found;
+		report(structure, keyType, names[w], keyCount, opCount, elapsed, histogram, bytesPerKey, target->height(),
+			collectStats ? target->statsJson() : "");
+		reportIdle(structure, keyType, names[w], keyCount, idle, bytesPerKey, target->height(),
+			collectStats ? target->statsJson() : "");
+
+		if (codes[w] == 'm' && target->filterBytes() > 0)
+		{
+			long long misses = 0;
+			long long passed = 0;
+			for (long long i = 0; i < opCount; i++)
+			{
+				if (kinds[i] == 4)
+				{
+					misses++;
+					passed += target->mayContain(makeMissKey(picks[i], tag));
+				}
+			}
+			printf("%-18s %-6s filter: %.3f%% false positives over %lld misses, %lld bytes (%.1f bits/key)\n", structure.c_str(),
+				keyType.c_str(), misses > 0 ? 100.0 * passed / misses : 0.0, misses, target->filterBytes(),
+				8.0 * target->filterBytes() / nextIndex);
+		}
+	}
+
+	{
+		shuffle(order.begin(), order.end(), engine);
+		LatencyHistogram histogram;
+		IdleWork idle = { LatencyHistogram(), 0, 0, 0 };
+		resetCounters();
+		long long start = nowNanoseconds();
+		for (long long i = 0; i < keyCount; i++)
+		{
+			KEY key = makeKey(order[i], tag);
+			long long opStart = nowNanoseconds();
+			target->remove(key);
+			histogram.record(nowNanoseconds() - opStart);
+			if ((i + 1) % idleInterval == 0)
+			{
+				runIdle(target, idle);
+			}
+		}
+		target->finish();
+		long long elapsed = nowNanoseconds() - start - idle.elapsed;
+		report(structure, keyType, "delete-random", keyCount, keyCount, elapsed, histogram, bytesPerKey, target->height(),
+			collectStats ? target->statsJson() : "");
+		reportIdle(structure, keyType, "delete-random", keyCount, idle, bytesPerKey, target->height(),
+			collectStats ? target->statsJson() : "");
+	}
+
+	delete target;
+}
+
+/*
+Load indexes appends makeKey(i) for every i in [first, last) that is a multiple of step, in ascending order.
+
+@param[in]: The tree to load, the index range, and the step between loaded indexes.
+@return: Nothing. The tree holds the keys.
+*/
+void loadIndexes(BTree<int>& tree, long long first, long long last, int step)
+{
+	int* tag = nullptr;
+	for (long long i = first; i < last; i++)
+	{
+		if (i % step == 0)
+		{
+			tree.insert(makeKey(i, tag));
+		}
+	}
+}
+
+/*
+Run set algebra times each whole tree operation against the per-key loop that gets the same result through insert, remove and search.
+Join moves the upper half of the keys from a second tree into the first, splitAt moves the upper half of one tree into an empty one, and
+the set operations combine the keys at even indexes with the keys at indexes divisible by 3, a third of which overlap. Operations counts
+the keys moved or visited, so both rows of a pair are comparable, and only the per-key rows have a latency distribution. Bytes per key
+is the memory of both trees over the keys left in the first.
+
+@param[in]: The number of keys the trees are built from.
+@return: Nothing. Results are printed and appended to results.
+*/
+void runSetAlgebra(long long keyCount)
+{
+	const char* names[] = { "join", "split-at", "union", "intersect", "difference" };
+	int* tag = nullptr;
+	long long half = keyCount / 2;
+
+	for (int w = 0; w < 5; w++)
+	{
+		for (int perKey = 0; perKey < 2; perKey++)
+		{
+			size_t bytesBefore = usedBytes();
+			BTree<int>* first = new BTree<int>(compare<int>);
+			BTree<int>* second = new BTree<int>(compare<int>);
+			long long operations = keyCount - half;
+
+			switch (w)
+			{
+				case 0:
+					loadIndexes(*first, 0, half, 1);
+					loadIndexes(*second, half, keyCount, 1);
+					break;
+				case 1:
+					loadIndexes(*first, 0, keyCount, 1);
+					break;
+				default:
+					loadIndexes(*first, 0, keyCount, 2);
+					loadIndexes(*second, 0, keyCount, 3);
+					operations = first->count() + second->count();
+					break;
+			}
+
+			LatencyHistogram histogram;
+			resetCounters();
+			long long start = nowNanoseconds();
+			if (perKey == 0)
+			{
+				switch (w)
+				{
+					case 0: first->join(*second); break;
+					case 1: first->splitAt(makeKey(half, tag), *second); break;
+					case 2: first->unionWith(*second); break;
+					case 3: first->intersectWith(*second); break;
+					case 4: first->differenceWith(*second); break;
+				}
+			}
+			else
+			{
+				for (long long i = w < 2 ? half : 0; i < keyCount; i++)
+				{
+					int key = makeKey(i, tag);
+					long long opStart = nowNanoseconds();
+					switch (w)
+					{
+						case 0:
+							first->insert(key);
+							second->remove(key);
+							break;
+						case 1:
+							second->insert(key);
+							first->remove(key);
+							break;
+						case 2:
+							if (i % 3 != 0) { continue; }
+							try { first->insert(key); } catch (DuplicateItemException&) {}
+							break;
+						case 3:
+							if (i % 2 != 0) { continue; }
+							try { second->search(key); } catch (ItemNotFoundException&) { first->remove(key); }
+							break;
+						case 4:
+							if (i % 3 != 0) { continue; }
+							try { first->remove(key); } catch (ItemNotFoundException&) {}
+							break;
+					}
+					histogram.record(nowNanoseconds() - opStart);
+				}
+			}
+			long long elapsed = nowNanoseconds() - start;
+			if (perKey == 0)
+			{
+				histogram.record(elapsed);
+			}
+
+			report("btree", "int", string(names[w]) + (perKey ? "-per-key" : ""), keyCount, operations, elapsed, histogram,
+				static_cast<double>(usedBytes() - bytesBefore) / first->count(), first->height(), collectStats ? first->stats().toJson() : "");
+			delete first;
+			delete second;
+		}
+	}
+}
+
+/*
+Write JSON stores every result as one object in a JSON array, with the seed and sizes repeated on each object so that files from
+different runs can be concatenated and compared line by line.
+
+@param[in]: The path of the file to write, and the seed of the run.
+@return: Nothing. The file is created or overwritten.
+*/
+void writeJson(const string& path, unsigned seed)
+{
+	ofstream out(path);
+	out << "[\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		Result& r = results[i];
+		out << "  {\"structure\": \"" << r.structure << "\", \"key_type\": \"" << r.keyType << "\", \"workload\": \"" << r.workload
+			<< "\", \"seed\": " << seed << ", \"skew\": " << zipfSkew << ", \"keys\": " << r.keys << ", \"operations\": " << r.operations
+			<< ", \"ops_per_second\": " << static_cast<long long>(r.opsPerSecond) << ", \"p50_ns\": " << r.p50
+			<< ", \"p99_ns\": " << r.p99 << ", \"p999_ns\": " << r.p999 << ", \"max_ns\": " << r.maxLatency
+			<< ", \"bytes_per_key\": " << r.bytesPerKey << ", \"height\": " << r.height
+			<< (r.treeStats.empty() ? "" : ", \"tree_stats\": " + r.treeStats)
+			<< (r.counters.empty() ? "" : ", \"counters\": " + r.counters) << "}"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "]\n";
+}
+
+/*
+Main function parses the command line, then runs the whole suite for each selected structure, first with int keys and then with URL
+string keys, or only the set algebra workloads when --set-algebra is given. Structures run one at a time, because every BTree shares the
+global MAGNITUDE set by its constructor.
+
+@param[in]: Command line options described in the file header.
+@return: 0 on success, 1 on a bad argument.
+*/
+int main(int argc, char* argv[])
+{
+	long long keyCount = 1000000;
+	long long opCount = -1;
+	unsigned seed = 42;
+	string structureList = "btree,btree-finger,btree-lazy,btree-incremental,btree-buffered,btree-filter,btree-hugepage,btree-cache,set,map";
+	string jsonPath;
+	bool setAlgebra = false;
+
+	for (int i = 1; i < argc; i += 2)
+	{
+		string option = argv[i];
+		if (option == "--stats")
+		{
+			collectStats = true;
+			i--;
+			continue;
+		}
+		if (option == "--set-algebra")
+		{
+			setAlgebra = true;
+			i--;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			cout << "Missing value for " << option << endl;
+			return 1;
+		}
+		if (option == "--keys") { keyCount = atoll(argv[i + 1]); }
+		else if (option == "--ops") { opCount = atoll(argv[i + 1]); }
+		else if (option == "--seed") { seed = static_cast<unsigned>(atoll(argv[i + 1])); }
+		else if (option == "--skew") { zipfSkew = atof(argv[i + 1]); }
+		else if (option == "--structures") { structureList = argv[i + 1]; }
+		else if (option == "--json") { jsonPath = argv[i + 1]; }
+		else
+		{
+			cout << "Unknown option " << option << endl;
+			return 1;
+		}
+	}
+	if (keyCount < 1 || keyCount > 100000000)
+	{
+		cout << "--keys must be between 1 and 100000000" << endl;
+		return 1;
+	}
+	if (zipfSkew <= 0 || zipfSkew == 1.0)
+	{
+		cout << "--skew must be above 0 and not 1" << endl;
+		return 1;
+	}
+	if (opCount < 0)
+	{
+		opCount = keyCount;
+	}
+
+	if (setAlgebra)
+	{
+		runSetAlgebra(keyCount);
+		if (!jsonPath.empty())
+		{
+			writeJson(jsonPath, seed);
+		}
+		return 0;
+	}
+
+	vector<string> structures;
+	stringstream list(structureList);
+	string name;
+	while (getline(list, name, ','))
+	{
+		if (name != "btree" && name != "btree-finger" && name != "btree-lazy" && name != "btree-incremental" && name != "btree-buffered"
+			&& name != "btree-filter" && name != "btree-hugepage" && name != "btree-cache" && name != "set" && name != "map")
+		{
+			cout << "Unknown structure " << name << endl;
+			return 1;
+		}
+		structures.push_back(name);
+	}
+
+	for (size_t i = 0; i < structures.size(); i++)
+	{
+		if (structures[i] == "set")
+		{
+			runSuite<StdTarget<int, set<int> >, int>("set", "int", keyCount, opCount, seed);
+		}
+		else if (structures[i] == "map")
+		{
+			runSuite<StdTarget<int, map<int, int> >, int>("map", "int", keyCount, opCount, seed);
+		}
+		else
+		{
+			runSuite<BTreeTarget<int>, int>(structures[i], "int", keyCount, opCount, seed);
+		}
+	}
+	for (size_t i = 0; i < structures.size(); i++)
+	{
+		if (structures[i] == "set")
+		{
+			runSuite<StdTarget<string, set<string> >, string>("set", "url", keyCount, opCount, seed);
+		}
+		else if (structures[i] == "map")
+		{
+			runSuite<StdTarget<string, map<string, int> >, string>("map", "url", keyCount, opCount, seed);
+		}
+		else
+		{
+			runSuite<BTreeTarget<string>, string>(structures[i], "url", keyCount, opCount, seed);
+		}
+	}
+
+	if (!jsonPath.empty())
+	{
+		writeJson(jsonPath, seed);
+	}
+
+	return 0;
+}
\ No newline at end of file
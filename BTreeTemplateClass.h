@@ -24,9 +24,22 @@ Using Visual Studio:
 #include <sstream>
 #include <cmath>
 #include <vector>
+#include <deque>
 #include <random>
 #include <exception>
 #include <ctime>
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <mutex>
+#ifdef BTREE_STATS
+#include <atomic>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using std::string;
@@ -110,6 +123,460 @@ public:
     }
 };
 
+/*
+Hot path counters are compiled in only when BTREE_STATS is defined, and BTREE_COUNT expands to nothing otherwise. Each thread bumps its own
+slot with relaxed loads and stores, so a counted operation never waits on a lock or a shared cache line. Slots register themselves on
+first use, and fold their totals into a retired slot when their thread exits, so counterSnapshot can sum every thread. The counters are
+process wide: they add up the work of every tree in every thread since the last resetCounters, so they are read through counterSnapshot
+rather than from any one tree's stats.
+
+@param[in]: Nothing. Counters are bumped through BTREE_COUNT(field, amount).
+@return: A BTreeCounters snapshot summed across threads, through counterSnapshot, or as a JSON object through toJson.
+*/
+struct BTreeCounters
+{
+    long long splits = 0;
+    long long borrows = 0;
+    long long merges = 0;
+    long long lookups = 0;
+    long long comparisons = 0;
+    long long nodesVisited = 0;
+    long long cacheHits = 0;
+    bool enabled = false;
+
+    string toJson() const
+    {
+        stringstream sstream;
+        sstream << "{\"enabled\": " << (enabled ? "true" : "false") << ", \"splits\": " << splits << ", \"borrows\": " << borrows
+            << ", \"merges\": " << merges << ", \"lookups\": " << lookups << ", \"comparisons\": " << comparisons
+            << ", \"nodes_visited\": " << nodesVisited << ", \"cache_hits\": " << cacheHits << "}";
+        return sstream.str();
+    }
+};
+
+#ifdef BTREE_STATS
+class BTreeCounterSlot
+{
+public:
+    atomic<long long> splits, borrows, merges, lookups, comparisons, nodesVisited, cacheHits;
+
+    BTreeCounterSlot() : splits(0), borrows(0), merges(0), lookups(0), comparisons(0), nodesVisited(0), cacheHits(0)
+    {
+        lock_guard<mutex> guard(registryMutex());
+        registry().push_back(this);
+    }
+
+    ~BTreeCounterSlot()
+    {
+        lock_guard<mutex> guard(registryMutex());
+        addTo(retired());
+        registry().erase(std::find(registry().begin(), registry().end(), this));
+    }
+
+    void addTo(BTreeCounters& total) const
+    {
+        total.splits += splits.load(memory_order_relaxed);
+        total.borrows += borrows.load(memory_order_relaxed);
+        total.merges += merges.load(memory_order_relaxed);
+        total.lookups += lookups.load(memory_order_relaxed);
+        total.comparisons += comparisons.load(memory_order_relaxed);
+        total.nodesVisited += nodesVisited.load(memory_order_relaxed);
+        total.cacheHits += cacheHits.load(memory_order_relaxed);
+    }
+
+    void clear()
+    {
+        splits.store(0, memory_order_relaxed);
+        borrows.store(0, memory_order_relaxed);
+        merges.store(0, memory_order_relaxed);
+        lookups.store(0, memory_order_relaxed);
+        comparisons.store(0, memory_order_relaxed);
+        nodesVisited.store(0, memory_order_relaxed);
+        cacheHits.store(0, memory_order_relaxed);
+    }
+
+    static mutex& registryMutex()
+    {
+        static mutex registryLock;
+        return registryLock;
+    }
+
+    static vector<BTreeCounterSlot*>& registry()
+    {
+        static vector<BTreeCounterSlot*> slots;
+        return slots;
+    }
+
+    static BTreeCounters& retired()
+    {
+        static BTreeCounters retiredTotals;
+        return retiredTotals;
+    }
+
+    static BTreeCounterSlot& local()
+    {
+        thread_local BTreeCounterSlot slot;
+        return slot;
+    }
+
+    //Bump adds amount to one counter of the calling thread's slot. Only that thread writes it, so a relaxed load and store will do.
+    static void bump(atomic<long long>& counter, long long amount)
+    {
+        counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+};
+
+#define BTREE_COUNT(field, amount) (BTreeCounterSlot::bump(BTreeCounterSlot::local().field, (amount)))
+
+inline BTreeCounters counterSnapshot()
+{
+    lock_guard<mutex> guard(BTreeCounterSlot::registryMutex());
+    BTreeCounters total = BTreeCounterSlot::retired();
+    total.enabled = true;
+    for (int i = 0; i < BTreeCounterSlot::registry().size(); i++)
+    {
+        BTreeCounterSlot::registry()[i]->addTo(total);
+    }
+    return total;
+}
+
+inline void resetCounters()
+{
+    lock_guard<mutex> guard(BTreeCounterSlot::registryMutex());
+    BTreeCounterSlot::retired() = BTreeCounters();
+    for (int i = 0; i < BTreeCounterSlot::registry().size(); i++)
+    {
+        BTreeCounterSlot::registry()[i]->clear();
+    }
+}
+#else
+#define BTREE_COUNT(field, amount) ((void)0)
+
+inline BTreeCounters counterSnapshot()
+{
+    return BTreeCounters();
+}
+
+inline void resetCounters()
+{
+}
+#endif
+
+/*
+Structural statistics are a snapshot taken by BTree::stats, which walks the whole tree. Levels are numbered from root (level 0), and each
+level records its node count, key count, and a histogram of how full its nodes are in tenths of MAGNITUDE - 1 keys (the last bucket also
+holds nodes at or over capacity). Bytes used counts node objects and the capacity of their vectors, but not memory owned by the keys.
+Filter bytes and lookup cache bytes are the sizes of the membership filter and the lookup cache, which are not part of bytes used.
+
+@param[in]: Nothing. Filled in by BTree::stats.
+@return: The snapshot as fields, or as a JSON object through toJson.
+*/
+struct BTreeLevelStats
+{
+    int nodes = 0;
+    long long keys = 0;
+    int fillHistogram[10] = {};
+};
+
+struct BTreeStats
+{
+    int height = 0;
+    int nodeCount = 0;
+    long long keyCount = 0;
+    long long bytesUsed = 0;
+    int pendingRestructures = 0;
+    int pendingWrites = 0;
+    long long droppedWrites = 0;
+    long long filterBytes = 0;
+    long long lookupCacheBytes = 0;
+    vector<BTreeLevelStats> levels;
+
+    string toJson() const
+    {
+        stringstream sstream;
+        sstream << "{\"height\": " << height << ", \"node_count\": " << nodeCount << ", \"key_count\": " << keyCount
+            << ", \"bytes_used\": " << bytesUsed << ", \"pending_restructures\": " << pendingRestructures
+            << ", \"pending_writes\": " << pendingWrites << ", \"dropped_writes\": " << droppedWrites
+            << ", \"filter_bytes\": " << filterBytes
+            << ", \"lookup_cache_bytes\": " << lookupCacheBytes << ", \"levels\": [";
+        for (int i = 0; i < levels.size(); i++)
+        {
+            sstream << (i == 0 ? "" : ", ") << "{\"nodes\": " << levels[i].nodes << ", \"keys\": " << levels[i].keys << ", \"fill_histogram\": [";
+            for (int j = 0; j < 10; j++)
+            {
+                sstream << (j == 0 ? "" : ", ") << levels[i].fillHistogram[j];
+            }
+            sstream << "]}";
+        }
+        sstream << "]}";
+        return sstream.str();
+    }
+};
+
+/*
+BTree arena hands out node memory from large regions backed by 2MB huge pages, so that a descent through the tree touches a few TLB
+entries instead of one per node. On Linux each region is mapped with mmap, first trying explicit huge pages (MAP_HUGETLB, which needs
+pages reserved by the administrator) and otherwise asking for transparent huge pages with madvise on a 2MB aligned mapping. Elsewhere
+regions come from operator new, which keeps the packing but not the huge pages. Blocks are handed out in multiples of 64 bytes, so keys
+never straddle more cache lines than they need to, and freed blocks are kept on a free list per size for reuse. Once every block has been
+returned, every region but the first is unmapped and the arena starts over at the start of the first, so a tree that is emptied and
+filled again does not map and unmap a region each time. Blocks over 64KB bypass the arena.
+There are two process wide arenas: hot holds internal nodes, which every descent goes through, and stays small enough to sit in a few huge
+pages, and cold holds the leaves. They are shared by all trees, so nodes can move between trees through join and splitAt, and a mutex
+guards them for trees used from different threads. On Linux, hot can also be asked for per NUMA node, below maxNumaNodes: the regions of
+such an arena are given to that node's memory through mbind with a preferred policy, so a tree whose readers run on one socket keeps its
+upper levels local to them. Where the node does not exist or mbind is missing, as on single node machines, the regions keep the default
+placement. Replicating the upper levels on every node, so that readers on all sockets are local at once, is left as a follow-up: every
+split, merge and buffered write would have to be applied to each replica.
+
+@param[in]: The size of the first region, the largest a region may grow to, and the NUMA node to place regions on, or -1 for any.
+@return: Blocks of memory through allocate, released through deallocate.
+*/
+class BTreeArena
+{
+    static const size_t blockUnit = 64;
+    static const size_t largestBlock = 65536;
+    static const size_t hugePageBytes = 2 * 1024 * 1024;
+    //MPOL_PREFERRED from numaif.h, which is only installed with libnuma.
+    static const int preferredPolicy = 1;
+
+    mutex arenaMutex;
+    vector<void*> freeLists;
+    vector<pair<char*, size_t>> regions;
+    char* bumpNext;
+    char* bumpEnd;
+    size_t firstRegionBytes;
+    size_t regionBytes;
+    size_t largestRegion;
+    size_t mappedBytes;
+    size_t liveBytes;
+    int numaNode;
+
+    //MapRegion reserves a new region of the given size, 2MB aligned and backed by huge pages where the system allows it.
+    char* mapRegion(size_t bytes)
+    {
+#ifdef __linux__
+#ifdef MAP_HUGETLB
+        void* region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (region != MAP_FAILED)
+        {
+            return static_cast<char*>(region);
+        }
+#endif
+        void* mapping = mmap(nullptr, bytes + hugePageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED)
+        {
+            throw bad_alloc();
+        }
+        char* start = static_cast<char*>(mapping);
+        char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(start) + hugePageBytes - 1) & ~(hugePageBytes - 1));
+        if (aligned > start)
+        {
+            munmap(start, aligned - start);
+        }
+        munmap(aligned + bytes, start + hugePageBytes - aligned);
+#ifdef MADV_HUGEPAGE
+        madvise(aligned, bytes, MADV_HUGEPAGE);
+#endif
+        return aligned;
+#else
+        return static_cast<char*>(::operator new(bytes));
+#endif
+    }
+
+    //PlaceRegion asks for a region's pages to come from numaNode's memory. It runs before the pages are first touched, and a failure
+    //leaves them on the default placement.
+    void placeRegion(char* region, size_t bytes)
+    {
+#if defined(__linux__) && defined(SYS_mbind)
+        if (numaNode >= 0)
+        {
+            unsigned long nodeMask = 1UL << numaNode;
+            syscall(SYS_mbind, region, bytes, preferredPolicy, &nodeMask, sizeof(nodeMask) * 8 + 1, 0);
+        }
+#endif
+    }
+
+    //ReleaseRegions hands every region but the first back to the system once no block is live, and restarts bump allocation at the
+    //start of the first region, with the next region sized as if only the first had been mapped.
+    void releaseRegions()
+    {
+        for (size_t i = 1; i < regions.size(); i++)
+        {
+#ifdef __linux__
+            munmap(regions[i].first, regions[i].second);
+#else
+            ::operator delete(regions[i].first);
+#endif
+        }
+        regions.resize(1);
+        freeLists.assign(freeLists.size(), nullptr);
+        bumpNext = regions[0].first;
+        bumpEnd = bumpNext + regions[0].second;
+        regionBytes = firstRegionBytes * 2 > largestRegion ? largestRegion : firstRegionBytes * 2;
+        mappedBytes = regions[0].second;
+    }
+
+public:
+    static const int maxNumaNodes = 8;
+
+    BTreeArena(size_t firstRegion, size_t maxRegion, int placeNode = -1)
+    {
+        freeLists.assign(largestBlock / blockUnit + 1, nullptr);
+        bumpNext = nullptr;
+        bumpEnd = nullptr;
+        firstRegionBytes = firstRegion;
+        regionBytes = firstRegion;
+        largestRegion = maxRegion;
+        mappedBytes = 0;
+        liveBytes = 0;
+        numaNode = placeNode;
+    }
+
+    void* allocate(size_t bytes)
+    {
+        if (bytes > largestBlock)
+        {
+            return ::operator new(bytes);
+        }
+
+        size_t unit = (bytes + blockUnit - 1) / blockUnit;
+        lock_guard<mutex> guard(arenaMutex);
+        liveBytes += unit * blockUnit;
+
+        if (freeLists[unit] != nullptr)
+        {
+            void* block = freeLists[unit];
+            freeLists[unit] = *static_cast<void**>(block);
+            return block;
+        }
+
+        if (bumpEnd - bumpNext < static_cast<ptrdiff_t>(unit * blockUnit))
+        {
+            bumpNext = mapRegion(regionBytes);
+            placeRegion(bumpNext, regionBytes);
+            regions.push_back(make_pair(bumpNext, regionBytes));
+            bumpEnd = bumpNext + regionBytes;
+            mappedBytes += regionBytes;
+            regionBytes = regionBytes * 2 > largestRegion ? largestRegion : regionBytes * 2;
+        }
+
+        void* block = bumpNext;
+        bumpNext += unit * blockUnit;
+        return block;
+    }
+
+    void deallocate(void* block, size_t bytes)
+    {
+        if (bytes > largestBlock)
+        {
+            ::operator delete(block);
+            return;
+        }
+
+        size_t unit = (bytes + blockUnit - 1) / blockUnit;
+        lock_guard<mutex> guard(arenaMutex);
+        liveBytes -= unit * blockUnit;
+        if (liveBytes == 0)
+        {
+            releaseRegions();
+            return;
+        }
+        *static_cast<void**>(block) = freeLists[unit];
+        freeLists[unit] = block;
+    }
+
+    //Live bytes are the blocks handed out and not yet returned, and mapped bytes the regions reserved so far.
+    size_t live()
+    {
+        lock_guard<mutex> guard(arenaMutex);
+        return liveBytes;
+    }
+
+    size_t mapped()
+    {
+        lock_guard<mutex> guard(arenaMutex);
+        return mappedBytes;
+    }
+
+    //Hot returns the arena for internal nodes, placed on numaNode's memory when numaNode is below maxNumaNodes. The arena of each node
+    //is created on first use.
+    static BTreeArena& hot(int numaNode = -1)
+    {
+        static BTreeArena arena(hugePageBytes, 16 * hugePageBytes);
+        if (numaNode < 0 || numaNode >= maxNumaNodes)
+        {
+            return arena;
+        }
+
+        static mutex localMutex;
+        static BTreeArena* localArenas[maxNumaNodes] = {};
+        lock_guard<mutex> guard(localMutex);
+        if (localArenas[numaNode] == nullptr)
+        {
+            localArenas[numaNode] = new BTreeArena(hugePageBytes, 16 * hugePageBytes, numaNode);
+        }
+        return *localArenas[numaNode];
+    }
+
+    static BTreeArena& cold()
+    {
+        static BTreeArena arena(hugePageBytes, 32 * hugePageBytes);
+        return arena;
+    }
+};
+
+/*
+BTree allocator lets the vectors inside a node take their buffers from the same arena as the node, or from the heap when arena is nullptr.
+It travels with the buffer when vectors are swapped or moved, so a buffer is always freed by the allocator that made it.
+
+@param[in]: The arena to allocate from, or nullptr for the heap.
+@return: An allocator usable by vector.
+*/
+template <typename T>
+struct BTreeAllocator
+{
+    typedef T value_type;
+    typedef true_type propagate_on_container_move_assignment;
+    typedef true_type propagate_on_container_swap;
+
+    BTreeArena* arena;
+
+    BTreeAllocator(BTreeArena* blockArena = nullptr) : arena(blockArena) {}
+
+    template <typename U>
+    BTreeAllocator(const BTreeAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count)
+    {
+        return static_cast<T*>(arena != nullptr ? arena->allocate(count * sizeof(T)) : ::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t count)
+    {
+        if (arena != nullptr)
+        {
+            arena->deallocate(block, count * sizeof(T));
+        }
+        else
+        {
+            ::operator delete(block);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const BTreeAllocator<U>& other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const BTreeAllocator<U>& other) const
+    {
+        return arena != other.arena;
+    }
+};
+
 /*
 Massive B-Tree class holds all of the functions needed to manipulate and access the tree. Uses a constructor to set up the B-Tree object, 
 and holds functions tied to insertion, deletion, search, count, and more. All functions are public besides findNode, which is used by
@@ -121,23 +588,49 @@ functions to locate a desired node to modify. Holds a node class inside of itsel
 template <typename DATA_TYPE>
 class BTree
 {
+    //A buffered write waiting in the write buffer: an insert of key, or a remove of key when isInsert is false.
+    struct BTreeMessage
+    {
+        DATA_TYPE key;
+        bool isInsert;
+    };
+    typedef vector<DATA_TYPE, BTreeAllocator<DATA_TYPE>> KeyVector;
+    typedef vector<BTreeMessage, BTreeAllocator<BTreeMessage>> MessageVector;
+
     /*
     B-Tree node class holds the structure needed to assemble a B-Tree node, including vectors for keys, children, and a pointer to the parent.
+    Each node also counts the keys and nodes held in its whole subtree. The order statistic functions use the key count to skip over
+    children, and splitAt uses the node count to size the trees it cuts off without walking them.
+    A node and its vectors live in arena, or on the heap when arena is nullptr.
     Also contains a helper function for finding the insertion point in a keyVector.
 
-    @param[in]: Nothing. Constructor creates a default condition for the node with empty vectors and nullptr parent.
+    @param[in]: The arena the node was allocated from. Constructor creates a default condition for the node with empty vectors and nullptr parent.
     @return: A B-Tree node that can be dereferenced and searched through via findKey.
     */
     class BTreeNode
     {
     public:
-        vector<DATA_TYPE> keyVector;
-        vector<BTreeNode*> childrenVector;
+        KeyVector keyVector;
+        vector<BTreeNode*, BTreeAllocator<BTreeNode*>> childrenVector;
         BTreeNode* parent; 
-
-        BTreeNode()
+        BTreeArena* arena;
+        int subtreeCount;
+        int subtreeNodes;
+        bool dirty;
+        bool overflowQueued;
+        //Number of lookup cache entries pointing at this node, so that deleting a node scans the cache only when some entry would be left
+        //pointing at freed memory.
+        int cachedLookups;
+
+        BTreeNode(BTreeArena* nodeArena) : keyVector(nodeArena), childrenVector(nodeArena)
         {
             parent = nullptr;
+            arena = nodeArena;
+            subtreeCount = 0;
+            subtreeNodes = 1;
+            dirty = false;
+            overflowQueued = false;
+            cachedLookups = 0;
         }
         /*
         findKey searches for an item, or a slot in the keyVector where item should be inserted. If a matching item is found, it returns
@@ -156,27 +649,146 @@ class BTree
             {
                 if (keyVector[keyIndex] == item)
                 {
+                    BTREE_COUNT(comparisons, keyIndex + 1);
                     return -1;
                 }
                 else if (keyVector[keyIndex] > item)
                 {
+                        BTREE_COUNT(comparisons, keyIndex + 1);
                         return keyIndex;
                 }
                 else if (keyIndex == keyVector.size() - 1)
                 {
+                        BTREE_COUNT(comparisons, keyIndex + 1);
                         return keyVector.size();
                 }
             }
+
+            return maxKeys;
         }
     };
 
     BTreeNode* root;
+    //Rightmost leaf is cached so that keys larger than the current maximum can be appended without a descent from root.
+    BTreeNode* rightmostLeaf;
+    //Number of consecutive inserts that went through the append fast path. Splits only turn asymmetric after a long enough run.
+    int appendRun;
+    //Finger remembers the node touched by the last search, insert or remove, so nearby keys can be found without restarting at root.
+    BTreeNode* finger;
     int nodeCount;
     int totalKeyCount;
+    //Lazy rebalancing leaves underflowed nodes in place down to lowWatermark keys, and lists them in dirtyNodes for compact to fix later.
+    bool lazyRebalance;
+    int lowWatermark;
+    vector<BTreeNode*> dirtyNodes;
+    //Compact leaves the first dirtyFloor entries of dirtyNodes alone, so that joinWith can fix the seam nodes it marks without compacting
+    //nodes that were already dirty. It is 0 outside joinWith.
+    int dirtyFloor;
+    //Incremental restructuring lets each operation spend restructureBudget steps on work queued by earlier ones. Overflowed parents wait
+    //in overflowNodes, oldest at the front, and underflowed parents wait in dirtyNodes, until a later operation has budget for them.
+    int restructureBudget;
+    deque<BTreeNode*> overflowNodes;
+    //Buffered write mode turns insert and remove into messages held at the tree in writeBuffer, sorted by key with at most one per key.
+    //Once it holds more than writeBufferBatch messages, each write applies the run of messages bound for one leaf, taking the runs in key
+    //order from sweepIndex and wrapping around. KeyScratch is reused between leaf merges to avoid allocations.
+    int writeBufferBatch;
+    MessageVector writeBuffer;
+    int sweepIndex;
+    //A buffered insert of a key that is already there, or remove of a key that is not, changes nothing and cannot throw. DroppedWrites
+    //counts them for stats, and unreportedDrops counts those not yet returned by flushWrites.
+    long long droppedWrites;
+    int unreportedDrops;
+    KeyVector keyScratch;
+    //With hugePageNodes set, new internal nodes come from the hot BTreeArena of hugePageNumaNode, and new leaves from the cold one.
+    bool hugePageNodes;
+    int hugePageNumaNode;
+    //The membership filter is an optional blocked Bloom filter over every key, in 256 bit blocks of 8 words. It was sized for
+    //filterCapacity keys at filterBitsPerKey bits each, and is rebuilt by the next insert or remove once more keys than that have been
+    //added, or once half as many have been removed, since removed keys cannot be cleared from it. An empty filterWords means lookups skip
+    //the filter until that rebuild.
+    int filterBitsPerKey;
+    vector<uint32_t> filterWords;
+    long long filterCapacity;
+    long long filterEntries;
+    long long filterRemoved;
+    //The lookup cache is an optional direct mapped table of recently found keys, each entry holding the node and index the key was found
+    //at, and the upper half of the key's hash as a tag so that an entry for another key is passed over without reading its node. An empty
+    //entry has a nullptr node. Entries are cleared when their node is deleted or the tree's nodes are handed to another tree, and an entry
+    //is only trusted if the key is still at its index, since inserts, removes, splits and merges shift keys between slots.
+    struct BTreeCacheEntry
+    {
+        BTreeNode* node;
+        uint32_t tag;
+        uint16_t keyIndex;
+    };
+    vector<BTreeCacheEntry> lookupCache;
+    //While fewer than 1 in 16 probes hit, only every cacheStride-th lookup probes the cache, so reads without hot keys skip the hash and
+    //the table. CacheCountdown counts down to the next probe, and the hit rate is measured again every 256 probes.
+    int cacheStride;
+    int cacheCountdown;
+    int cacheProbes;
+    int cacheHitsSeen;
+    //A step on the path from root to a key during an in order walk: the node, and the index of the next key to visit in it.
+    struct BTreePathStep
+    {
+        BTreeNode* node;
+        int keyIndex;
+    };
+    //Pointer definition for hash function in main, used by the membership filter and the lookup cache.
+    size_t (*hashItem)(const DATA_TYPE& item);
     //Pointer definition for compare function in main.
     int (*compare)(const DATA_TYPE& item1, const DATA_TYPE& item2);
 
     BTreeNode* findNode(BTreeNode* startNode, const DATA_TYPE& item);
+    BTreeNode* findNodeNear(const DATA_TYPE& item);
+    void insertAt(const DATA_TYPE& item, bool nearFinger);
+    void removeAt(const DATA_TYPE& item, bool nearFinger);
+    bool insertItem(const DATA_TYPE& item, bool nearFinger);
+    bool removeItem(const DATA_TYPE& item, bool nearFinger);
+    DATA_TYPE searchAt(const DATA_TYPE& item, bool nearFinger);
+    const DATA_TYPE* locateItem(const DATA_TYPE& item, bool nearFinger);
+    void bufferWrite(const DATA_TYPE& item, bool isInsert);
+    void drainWrites();
+    void dropWrite();
+    int applyRun(int first);
+    int applyToLeaf(int first);
+    int mergeRun(BTreeNode* leaf, int first, int last);
+    int findMessage(const DATA_TYPE& key);
+    void retireNode(BTreeNode* node, BTreeNode* replacement);
+    void unmarkDirty(BTreeNode* node);
+    void handleUnderflow(BTreeNode* underNode);
+    void handleOverflow(BTreeNode* overNode, bool appending);
+    void stepDeferredWork();
+    int splitQueued(int budget);
+    void recount(BTreeNode* node);
+    void adjustCounts(BTreeNode* node, int delta, int nodeDelta = 0);
+    int countBelow(const DATA_TYPE& item, bool inclusive);
+    void settle();
+    void resetTree();
+    void clearTree();
+    void takeTree(BTree& other);
+    void adoptRoot(BTreeNode* node);
+    void joinWith(const DATA_TYPE& separator, BTree& other);
+    void combineWith(BTree& other, int combineCase);
+    void descendPath(vector<BTreePathStep>& path, BTreeNode* node);
+    void seekPath(vector<BTreePathStep>& path, const DATA_TYPE& item);
+    void advancePath(vector<BTreePathStep>& path);
+    uint64_t filterHash(const DATA_TYPE& item);
+    BTreeNode* newNode(bool isLeaf);
+    void deleteNode(BTreeNode* node);
+    BTreeNode* relocateNode(BTreeNode* node);
+    uint32_t* filterBlock(uint64_t hash);
+    uint32_t filterMask(uint64_t hash, int word);
+    void filterAdd(const DATA_TYPE& item);
+    void filterMark(const DATA_TYPE& item);
+    void filterAddSubtree(BTreeNode* node);
+    void rebuildFilter();
+    void refreshFilter();
+    void dropFilter();
+    BTreeCacheEntry& cacheEntry(uint64_t hash);
+    void dropLookup(BTreeCacheEntry& entry);
+    void invalidateLookups();
+    void sampleCache(bool hit);
 
     /*
     Post order delete is used by destructor to travel down to leaves, and slowly delete all the nodes in the tree from the bottom up,
@@ -197,35 +809,161 @@ class BTree
                 postOrderDelete(node->childrenVector[i]);
             }
         }
-        delete node;
+        deleteNode(node);
     }
 
 public:
     BTree(int (*cmp)(const DATA_TYPE& item1, const DATA_TYPE& item2));
     ~BTree();
 
-    void insert(const DATA_TYPE& item);
-    void resolveOverflow(BTreeNode* overNode);
-    void remove(const DATA_TYPE& item);
+    void resolveOverflow(BTreeNode* overNode, bool appending = false);
     void resolveUnderflow(BTreeNode* underNode);
     void leftBorrow(BTreeNode* parent, BTreeNode* sibling, BTreeNode* underNode, int underIndex);
     void rightBorrow(BTreeNode* parent, BTreeNode* sibling, BTreeNode* underNode, int underIndex);
     void leftMerge(BTreeNode* parent, BTreeNode* sibling, BTreeNode* underNode, int underIndex);
     void rightMerge(BTreeNode* parent, BTreeNode* sibling, BTreeNode* underNode, int underIndex);
     void underflowAddresses(BTreeNode* sibling, BTreeNode* underNode, int resolveCase);
-    int search(const DATA_TYPE& item);
 
-    //Count function takes no parameter, and only returns the total amount of keys in the tree.
+    //Insert, remove and search start their descent at root. In buffered write mode, insert and remove never throw; see setWriteBuffer.
+    void insert(const DATA_TYPE& item)
+    {
+        insertAt(item, false);
+    }
+
+    void remove(const DATA_TYPE& item)
+    {
+        removeAt(item, false);
+    }
+
+    DATA_TYPE search(const DATA_TYPE& item)
+    {
+        return searchAt(item, false);
+    }
+
+    //Near variants start from the finger left by the previous operation, and are cheaper when consecutive keys are close together.
+    void insertNear(const DATA_TYPE& item)
+    {
+        insertAt(item, true);
+    }
+
+    void removeNear(const DATA_TYPE& item)
+    {
+        removeAt(item, true);
+    }
+
+    DATA_TYPE searchNear(const DATA_TYPE& item)
+    {
+        return searchAt(item, true);
+    }
+
+    //Count function takes no parameter, and only returns the total amount of keys in the tree. Buffered writes are flushed first.
     int count()
     {
+        if (!writeBuffer.empty())
+        {
+            drainWrites();
+        }
         return totalKeyCount;
     }
 
+    //Rank returns how many keys in the tree are smaller than item. Runs in O(log n) using subtree counts, after flushing buffered writes.
+    int rank(const DATA_TYPE& item)
+    {
+        if (!writeBuffer.empty())
+        {
+            drainWrites();
+        }
+        return countBelow(item, false);
+    }
+
+    //CountRange returns how many keys fall in the inclusive range [low, high]. Runs in O(log n) using subtree counts, after flushing
+    //buffered writes.
+    int countRange(const DATA_TYPE& low, const DATA_TYPE& high)
+    {
+        if (high < low)
+        {
+            return 0;
+        }
+        if (!writeBuffer.empty())
+        {
+            drainWrites();
+        }
+        return countBelow(high, true) - countBelow(low, false);
+    }
+
+    DATA_TYPE select(int k);
+    int scan(const DATA_TYPE& low, int limit, vector<DATA_TYPE>& out);
+    BTreeStats stats();
+
+    void setLazyRebalance(bool enabled, int watermark = 1);
+    int compact(int budget = -1);
+
+    //DirtyCount returns how many underflowed nodes are waiting for compact while lazy rebalancing is on.
+    int dirtyCount()
+    {
+        return dirtyNodes.size();
+    }
+
+    void setIncrementalRestructure(int budget);
+
+    //PendingRestructures returns how many overflowed or underflowed nodes are waiting for a later operation to fix them.
+    int pendingRestructures()
+    {
+        return overflowNodes.size() + dirtyNodes.size();
+    }
+
+    void setWriteBuffer(int batch);
+    int flushWrites();
+
+    //PendingWrites returns how many buffered inserts and removes have not been applied yet.
+    int pendingWrites()
+    {
+        return writeBuffer.size();
+    }
+
+    void join(BTree& other);
+    void splitAt(const DATA_TYPE& key, BTree& right);
+
+    //UnionWith, intersectWith and differenceWith replace the keys of this tree with its union, intersection or difference with other, in
+    //time linear in the size of both trees. Other is left unchanged.
+    void unionWith(BTree& other)
+    {
+        combineWith(other, 1);
+    }
+
+    void intersectWith(BTree& other)
+    {
+        combineWith(other, 2);
+    }
+
+    void differenceWith(BTree& other)
+    {
+        combineWith(other, 3);
+    }
+
+    void setMembershipFilter(int bitsPerKey, size_t (*hash)(const DATA_TYPE& item));
+    void setHugePageNodes(bool enabled, int numaNode = -1);
+    void setLookupCache(int slots, size_t (*hash)(const DATA_TYPE& item));
+    bool mayContain(const DATA_TYPE& item);
+    bool contains(const DATA_TYPE& item);
+    bool containsNear(const DATA_TYPE& item);
+
     //NodeCounter function takes no parameter, and returns number of nodes in tree. Used for driver testing.
     int nodeCounter()
     {
         return nodeCount;
     }
+
+    //Height function takes no parameter, and returns the number of levels in the tree. Used for benchmark reports.
+    int height()
+    {
+        int levels = 0;
+        for (BTreeNode* node = root; node != nullptr; node = node->childrenVector.empty() ? nullptr : node->childrenVector.front())
+        {
+            levels++;
+        }
+        return levels;
+    }
 };
 
 /*
@@ -243,10 +981,33 @@ BTree<DATA_TYPE>::BTree(int (*cmp)(const DATA_TYPE& item1, const DATA_TYPE& item
     nodeCount = 0;
     totalKeyCount = 0;
     root = nullptr;
+    rightmostLeaf = nullptr;
+    appendRun = 0;
+    finger = nullptr;
+    lazyRebalance = false;
+    lowWatermark = 1;
+    dirtyFloor = 0;
+    restructureBudget = 0;
+    writeBufferBatch = 0;
+    sweepIndex = 0;
+    droppedWrites = 0;
+    unreportedDrops = 0;
+    filterBitsPerKey = 0;
+    filterCapacity = 0;
+    filterEntries = 0;
+    filterRemoved = 0;
+    hashItem = nullptr;
+    cacheStride = 1;
+    cacheCountdown = 1;
+    cacheProbes = 0;
+    cacheHitsSeen = 0;
+    hugePageNodes = false;
+    hugePageNumaNode = -1;
 }
 
 /*
-BTree destructor calls on postOrderDelete at the root to clean up all allocated memory in the tree, destroying it.
+BTree destructor empties the lookup cache and calls on postOrderDelete at the root to clean up all allocated memory in the tree, destroying
+it.
 
 @param[in]: Nothing.
 @return: An empty B-Tree object with all nodes deleted.
@@ -254,73 +1015,142 @@ BTree destructor calls on postOrderDelete at the root to clean up all allocated
 template <typename DATA_TYPE>
 BTree<DATA_TYPE>::~BTree()
 {
+    invalidateLookups();
     postOrderDelete(root);
 }
 
 /*
-Insert function first checks for empty tree conditions, and creates a root if necessary. Otherwise, it uses findNode and findKey to locate
-the point of insertion for the new key, throwing an exception if the item already exists. It then inserts the key, and checks if an
-overflow has occurred.
+Insert function inserts the item through insertItem, and throws an exception if the item already exists. In buffered write mode it hands
+the item to bufferWrite instead and never throws: an insert of a key already in the tree is dropped when it is applied, and counted by
+flushWrites and stats.
 
-@param[in]: An item to be inserted into the tree.
+@param[in]: An item to be inserted into the tree, and whether to start from the finger instead of root.
 @return: The B-Tree with the new key inserted.
 */
 template <typename DATA_TYPE>
-void BTree<DATA_TYPE>::insert(const DATA_TYPE& item)
+void BTree<DATA_TYPE>::insertAt(const DATA_TYPE& item, bool nearFinger)
 {
-    if (nodeCount == 0)
+    refreshFilter();
+
+    if (writeBufferBatch > 0)
     {
-        root = new BTreeNode();
-        root->keyVector.push_back(item);
-        nodeCount++;
-        totalKeyCount++;
+        bufferWrite(item, true);
         return;
     }
 
-    BTreeNode* insertNode = findNode(root, item);
-
-    int checkDuplicate = insertNode->findKey(item);
-    if (checkDuplicate == -1)
+    if (!insertItem(item, nearFinger))
     {
         DuplicateItemException exception(__LINE__, "Duplicate item detected. Unable to insert");
         throw exception;
     }
-
-    insertNode->keyVector.insert(insertNode->keyVector.begin() + checkDuplicate, item);
-    
-    if(insertNode->keyVector.size() > MAGNITUDE - 1)
-    {
-        resolveOverflow(insertNode);
-    }
-
-    totalKeyCount++;
+}
+
+/*
+Insert item first checks for empty tree conditions, and creates a root if necessary. Keys larger than every key in the tree are
+appended straight onto the cached rightmost leaf, which keeps monotonically increasing inserts from descending through the tree. If at
+least half a node's worth of such appends arrive in a row, an overflow of the rightmost leaf is split asymmetrically. Otherwise,
+it uses findNode and findKey to locate the point of insertion for the new key, and returns false if the item already exists. It then
+inserts the key, and checks if an overflow has occurred. Only a key that was inserted is added to the membership filter, so duplicates do
+not count towards its next rebuild. When nearFinger is set, the descent starts from the finger through findNodeNear.
+
+@param[in]: An item to be inserted into the tree, and whether to start from the finger instead of root.
+@return: True if the key was inserted, or false if it was already in the tree.
+*/
+template <typename DATA_TYPE>
+bool BTree<DATA_TYPE>::insertItem(const DATA_TYPE& item, bool nearFinger)
+{
+    if (nodeCount == 0)
+    {
+        root = newNode(true);
+        root->keyVector.push_back(item);
+        root->subtreeCount = 1;
+        rightmostLeaf = root;
+        finger = root;
+        nodeCount++;
+        totalKeyCount++;
+        filterAdd(item);
+        return true;
+    }
+
+    if (!rightmostLeaf->keyVector.empty() && rightmostLeaf->keyVector.back() < item)
+    {
+        rightmostLeaf->keyVector.push_back(item);
+        appendRun++;
+        finger = rightmostLeaf;
+        adjustCounts(rightmostLeaf, 1);
+
+        if (rightmostLeaf->keyVector.size() > MAGNITUDE - 1)
+        {
+            resolveOverflow(rightmostLeaf, appendRun > (MAGNITUDE - 1) / 2);
+        }
+
+        totalKeyCount++;
+        filterAdd(item);
+        stepDeferredWork();
+        return true;
+    }
+
+    BTREE_COUNT(lookups, 1);
+    BTreeNode* insertNode = nearFinger ? findNodeNear(item) : findNode(root, item);
+    finger = insertNode;
+    appendRun = 0;
+
+    int checkDuplicate = insertNode->findKey(item);
+    if (checkDuplicate == -1)
+    {
+        return false;
+    }
+
+    insertNode->keyVector.insert(insertNode->keyVector.begin() + checkDuplicate, item);
+    adjustCounts(insertNode, 1);
+    
+    if(insertNode->keyVector.size() > MAGNITUDE - 1)
+    {
+        resolveOverflow(insertNode);
+    }
+
+    totalKeyCount++;
+    filterAdd(item);
+    stepDeferredWork();
+    return true;
 }
 
 /*
 Resolve overflow function handles an overflow after an insertion by splitting the overflowed node with a newly created sibling, and moving
 one key up to the parent, if it exists. If there is no parent, it moves a key up to a newly created root. The function also calls recursively
-if the parent overflows.
+if the parent overflows, through handleOverflow so that incremental restructuring can defer it. A node that was left holding far more than
+MAGNITUDE - 1 keys by deferred splits can still overflow after one split, and is handed to handleOverflow again. When the overflow was
+caused by an append onto the right edge of the tree, the split is made asymmetric: the overflowed node keeps all but one key, and the new
+sibling starts with only the last key. Sequential inserts then leave full nodes behind them instead of half empty ones.
 
-@param[in]: A node that has overflowed with keys.
+@param[in]: A node that has overflowed with keys, and whether the overflow came from an append onto the right edge of the tree.
 @return: The B-Tree with 1-2 new nodes based on the overflow cased, with all nodes no longer full.
 */
 template <typename DATA_TYPE>
-void BTree<DATA_TYPE>::resolveOverflow(BTreeNode* overNode)
+void BTree<DATA_TYPE>::resolveOverflow(BTreeNode* overNode, bool appending)
 {
-    BTreeNode* sibling = new BTreeNode();
+    BTreeNode* sibling = newNode(overNode->childrenVector.empty());
+    BTREE_COUNT(splits, 1);
+
+    if (overNode == rightmostLeaf)
+    {
+        rightmostLeaf = sibling;
+    }
+
+    int keyMidpoint = overNode->keyVector.size() / 2;
+    if (overNode->keyVector.size() % 2 == 0) { keyMidpoint--; }
+    if (appending) { keyMidpoint = overNode->keyVector.size() - 2; }
 
     if (overNode->parent == nullptr)
     {
-        BTreeNode* parent = new BTreeNode();
+        BTreeNode* parent = newNode(false);
         overNode->parent = parent;
         parent->childrenVector.push_back(overNode);
         sibling->parent = parent;
         parent->childrenVector.push_back(sibling);
         root = parent;
 
-        int keyMidpoint = overNode->keyVector.size() / 2;
-        if (overNode->keyVector.size() % 2 == 0) { keyMidpoint--; }
-        
+
         sibling->keyVector.assign(overNode->keyVector.begin() + (keyMidpoint + 1), overNode->keyVector.end());
         overNode->keyVector.erase(overNode->keyVector.begin() + (keyMidpoint + 1), overNode->keyVector.end());
 
@@ -343,6 +1173,9 @@ void BTree<DATA_TYPE>::resolveOverflow(BTreeNode* overNode)
             }
         }
 
+        recount(overNode);
+        recount(sibling);
+        recount(parent);
         nodeCount += 2;
     }
     else
@@ -356,8 +1189,6 @@ void BTree<DATA_TYPE>::resolveOverflow(BTreeNode* overNode)
         parent->childrenVector.insert(parent->childrenVector.begin() + (nodeIndex + 1), sibling);
         sibling->parent = parent;
 
-        int keyMidpoint = overNode->keyVector.size() / 2;
-        if (overNode->keyVector.size() % 2 == 0) { keyMidpoint--; }
 
         sibling->keyVector.assign(overNode->keyVector.begin() + (keyMidpoint + 1), overNode->keyVector.end());
         overNode->keyVector.erase(overNode->keyVector.begin() + (keyMidpoint + 1), overNode->keyVector.end());
@@ -381,40 +1212,89 @@ void BTree<DATA_TYPE>::resolveOverflow(BTreeNode* overNode)
             }
         }
 
+        recount(overNode);
+        recount(sibling);
+        adjustCounts(parent, 0, 1);
         nodeCount += 1;
 
         if (parent->keyVector.size() > MAGNITUDE - 1)
         {
-            resolveOverflow(parent);
+            handleOverflow(parent, appending);
         }
     }
+
+    if (overNode->keyVector.size() > MAGNITUDE - 1)
+    {
+        handleOverflow(overNode, false);
+    }
+    if (sibling->keyVector.size() > MAGNITUDE - 1)
+    {
+        handleOverflow(sibling, false);
+    }
 }
 
 /*
-Remove function first checks to make sure the tree isn't empty, then uses findNode and findKey to locate the deleted key. If the key does
-not exist, an exception will be thrown. It then finds the index in the vector to delete from, and follows either a leaf deletion or a delete
-by copy algorithm depending on the location of the node being deleted from. In both cases, a leaf node is checked for underflow, and
-resolveUnderflow is called if underflow has occurred.
+Remove function first checks to make sure the tree isn't empty, then removes the item through removeItem, and throws an exception if the
+key does not exist. In buffered write mode it hands the item to bufferWrite instead and never throws: a remove of a missing key, or from an
+empty tree, is dropped when it is applied, and counted by flushWrites and stats.
 
-@param[in]: An item to be deleted from the tree.
+@param[in]: An item to be deleted from the tree, and whether to start from the finger instead of root.
 @return: The B-Tree without the deleted key.
 */
 template <typename DATA_TYPE>
-void BTree<DATA_TYPE>::remove(const DATA_TYPE& item)
+void BTree<DATA_TYPE>::removeAt(const DATA_TYPE& item, bool nearFinger)
 {
+    refreshFilter();
+
+    if (writeBufferBatch > 0)
+    {
+        bufferWrite(item, false);
+        return;
+    }
+
     if (nodeCount == 0 || root->keyVector.size() == 0)
     {
         TreeEmptyException exception(__LINE__, "Tree is Empty. Unable to delete");
         throw exception;
     }
 
-    BTreeNode* deleteNode = findNode(root, item);
-
-    if (deleteNode->findKey(item) != -1)
+    if (!removeItem(item, nearFinger))
     {
         ItemNotFoundException exception(__LINE__, "Item to be deleted not found");
         throw exception;
     }
+}
+
+/*
+Remove item uses findNode and findKey to locate the deleted key, and returns false if the tree is empty or the key does not exist. It then
+finds the index in the vector to delete from, and follows either a leaf deletion or a delete by copy algorithm depending on the location of
+the node being deleted from. In both cases, a leaf node is checked for underflow, and handleUnderflow is called if underflow has occurred.
+When nearFinger is set, the descent starts from the finger through findNodeNear.
+
+@param[in]: An item to be deleted from the tree, and whether to start from the finger instead of root.
+@return: True if the key was deleted, or false if it was not in the tree.
+*/
+template <typename DATA_TYPE>
+bool BTree<DATA_TYPE>::removeItem(const DATA_TYPE& item, bool nearFinger)
+{
+    if (nodeCount == 0 || root->keyVector.size() == 0)
+    {
+        return false;
+    }
+
+    BTREE_COUNT(lookups, 1);
+    BTreeNode* deleteNode = nearFinger ? findNodeNear(item) : findNode(root, item);
+    finger = deleteNode;
+
+    if (deleteNode->findKey(item) != -1)
+    {
+        return false;
+    }
+    filterRemoved++;
+    if (!lookupCache.empty())
+    {
+        dropLookup(cacheEntry(filterHash(item)));
+    }
 
     int deleteIndex = 0;
 
@@ -431,10 +1311,11 @@ void BTree<DATA_TYPE>::remove(const DATA_TYPE& item)
     if (deleteNode->childrenVector.empty())
     {
         deleteNode->keyVector.erase(deleteNode->keyVector.begin() + deleteIndex);
+        adjustCounts(deleteNode, -1);
 
         if (deleteNode->keyVector.size() < (MAGNITUDE - 1) / 2)
         {
-            resolveUnderflow(deleteNode);
+            handleUnderflow(deleteNode);
         }
     }
     else
@@ -450,19 +1331,24 @@ void BTree<DATA_TYPE>::remove(const DATA_TYPE& item)
         predecessorNode->keyVector.pop_back();
         deleteNode->keyVector.erase(deleteNode->keyVector.begin() + deleteIndex);
         deleteNode->keyVector.insert(deleteNode->keyVector.begin() + deleteIndex, pred);
+        adjustCounts(predecessorNode, -1);
 
         if (predecessorNode->keyVector.size() < (MAGNITUDE - 1) / 2) 
         { 
-            resolveUnderflow(predecessorNode); 
+            handleUnderflow(predecessorNode); 
         }
     }
 
     totalKeyCount--;
+    stepDeferredWork();
+    return true;
 }
 
 /*
 Resolve underflow function resolves underflow conditions. First, it identifies which child the underflowed node is to its parent, and then
-follows a series of prioritized conditionals to determine if a borrow or a merge is necessary from the left or right sibling.
+follows a series of prioritized conditionals to determine if a borrow or a merge is necessary from the left or right sibling. Merges are
+allowed with any sibling at or below the minimum, since nodes on the right edge can sit below it after an append split. A node that is
+still under the minimum after one borrow (an append split or lazy rebalancing can leave it several keys short) keeps being resolved.
 
 @param[in]: A node that has underflow.
 @return: A restructured B-Tree based on the condition deduced by the conditionals.
@@ -470,7 +1356,7 @@ follows a series of prioritized conditionals to determine if a borrow or a merge
 template <typename DATA_TYPE>
 void BTree<DATA_TYPE>::resolveUnderflow(BTreeNode* underNode)
 {
-    if (nodeCount == 1)
+    if (nodeCount == 1 || underNode->parent == nullptr)
     {
         return;
     }
@@ -496,11 +1382,15 @@ void BTree<DATA_TYPE>::resolveUnderflow(BTreeNode* underNode)
         if(leftSibling->keyVector.size() > (MAGNITUDE - 1) / 2)
         {
             leftBorrow(parent, leftSibling, underNode, underIndex);
+            if (underNode->keyVector.size() < (MAGNITUDE - 1) / 2)
+            {
+                resolveUnderflow(underNode);
+            }
             return;
         }
         else if (underNode == parent->childrenVector.back())
         {
-            if (leftSibling->keyVector.size() == (MAGNITUDE - 1) / 2)
+            if (leftSibling->keyVector.size() <= (MAGNITUDE - 1) / 2)
             {
                 leftMerge(parent, leftSibling, underNode, underIndex);
 
@@ -513,15 +1403,19 @@ void BTree<DATA_TYPE>::resolveUnderflow(BTreeNode* underNode)
             if (rightSibling->keyVector.size() > (MAGNITUDE - 1) / 2)
             {
                 rightBorrow(parent, rightSibling, underNode, underIndex);
+                if (underNode->keyVector.size() < (MAGNITUDE - 1) / 2)
+                {
+                    resolveUnderflow(underNode);
+                }
                 return;
             }
-            else if (leftSibling->keyVector.size() == (MAGNITUDE - 1) / 2)
+            else if (leftSibling->keyVector.size() <= (MAGNITUDE - 1) / 2)
             {
                 leftMerge(parent, leftSibling, underNode, underIndex);
 
                 return;
             }
-            else if (rightSibling->keyVector.size() == (MAGNITUDE - 1) / 2)
+            else if (rightSibling->keyVector.size() <= (MAGNITUDE - 1) / 2)
             {
                 rightMerge(parent, rightSibling, underNode, underIndex);
 
@@ -535,9 +1429,13 @@ void BTree<DATA_TYPE>::resolveUnderflow(BTreeNode* underNode)
         if (rightSibling->keyVector.size() > (MAGNITUDE - 1) / 2)
         {
             rightBorrow(parent, rightSibling, underNode, underIndex);
+            if (underNode->keyVector.size() < (MAGNITUDE - 1) / 2)
+            {
+                resolveUnderflow(underNode);
+            }
             return;
         }
-        else if (rightSibling->keyVector.size() == (MAGNITUDE - 1) / 2)
+        else if (rightSibling->keyVector.size() <= (MAGNITUDE - 1) / 2)
         {
             rightMerge(parent, rightSibling, underNode, underIndex);
             return;
@@ -556,6 +1454,7 @@ necessary.
 template <typename DATA_TYPE>
 void BTree<DATA_TYPE>::leftBorrow(BTreeNode* parent, BTreeNode* sibling, BTreeNode* underNode, int underIndex)
 {
+    BTREE_COUNT(borrows, 1);
     DATA_TYPE temp1 = sibling->keyVector.back();
     DATA_TYPE temp2 = parent->keyVector[underIndex - 1];
     underNode->keyVector.insert(underNode->keyVector.begin(), temp2);
@@ -565,6 +1464,8 @@ void BTree<DATA_TYPE>::leftBorrow(BTreeNode* parent, BTreeNode* sibling, BTreeNo
     {
         underflowAddresses(sibling, underNode, 1);
     }
+    recount(sibling);
+    recount(underNode);
 }
 
 /*
@@ -578,6 +1479,7 @@ necessary.
 template <typename DATA_TYPE>
 void BTree<DATA_TYPE>::rightBorrow(BTreeNode* parent, BTreeNode* sibling, BTreeNode* underNode, int underIndex)
 {
+    BTREE_COUNT(borrows, 1);
     DATA_TYPE temp1 = sibling->keyVector.front();
     DATA_TYPE temp2 = parent->keyVector[underIndex];
     underNode->keyVector.push_back(temp2);
@@ -587,6 +1489,8 @@ void BTree<DATA_TYPE>::rightBorrow(BTreeNode* parent, BTreeNode* sibling, BTreeN
     {
         underflowAddresses(sibling, underNode, 3);
     }
+    recount(sibling);
+    recount(underNode);
 }
 
 /*
@@ -600,6 +1504,7 @@ node. It then checks to see if the root needs to be reset, or if a recursive cal
 template <typename DATA_TYPE>
 void BTree<DATA_TYPE>::leftMerge(BTreeNode* parent, BTreeNode* sibling, BTreeNode* underNode, int underIndex)
 {
+    BTREE_COUNT(merges, 1);
     DATA_TYPE temp1 = parent->keyVector[underIndex - 1];
     sibling->keyVector.push_back(temp1);
     parent->keyVector.erase(parent->keyVector.begin() + (underIndex - 1));
@@ -610,25 +1515,24 @@ void BTree<DATA_TYPE>::leftMerge(BTreeNode* parent, BTreeNode* sibling, BTreeNod
     {
         underflowAddresses(sibling, underNode, 2);
     }
+    recount(sibling);
 
-    delete underNode;
-    nodeCount--;
+    retireNode(underNode, sibling);
 
     if (parent == root)
     {
         if (parent->keyVector.size() == 0)
         {
             root = sibling;
-            delete parent;
+            retireNode(parent, sibling);
             root->parent = nullptr;
-            nodeCount--;
         }
     }
     else
     {
         if (parent->keyVector.size() < (MAGNITUDE - 1) / 2)
         {
-            resolveUnderflow(parent);
+            handleUnderflow(parent);
         }
     }
 }
@@ -644,6 +1548,7 @@ node. It then checks to see if the root needs to be reset, or if a recursive cal
 template <typename DATA_TYPE>
 void BTree<DATA_TYPE>::rightMerge(BTreeNode* parent, BTreeNode* sibling, BTreeNode* underNode, int underIndex)
 {
+    BTREE_COUNT(merges, 1);
     DATA_TYPE temp1 = parent->keyVector[underIndex];
     sibling->keyVector.insert(sibling->keyVector.begin(), temp1);
     parent->keyVector.erase(parent->keyVector.begin() + (underIndex));
@@ -654,25 +1559,24 @@ void BTree<DATA_TYPE>::rightMerge(BTreeNode* parent, BTreeNode* sibling, BTreeNo
     {
         underflowAddresses(sibling, underNode, 4);
     }
+    recount(sibling);
 
-    delete underNode;
-    nodeCount--;
+    retireNode(underNode, sibling);
 
     if (parent == root)
     {
         if (parent->keyVector.size() == 0)
         {
             root = sibling;
-            delete parent;
+            retireNode(parent, sibling);
             root->parent = nullptr;
-            nodeCount--;
         }
     }
     else
     {
         if (parent->keyVector.size() < (MAGNITUDE - 1) / 2)
         {
-            resolveUnderflow(parent);
+            handleUnderflow(parent);
         }
     }
 }
@@ -726,25 +1630,95 @@ void BTree<DATA_TYPE>::underflowAddresses(BTreeNode* sibling, BTreeNode* underNo
 }
 
 /*
-Search uses findNode to locate a node where an item should be, and then loops across that node's vector until it hits the end
-or finds the searched item. If not found, and exception is thrown
+Search uses locateItem to find the searched item, and throws an exception if it is not found.
 
-@param[in]: An item to be searched for.
+@param[in]: An item to be searched for, and whether to start from the finger instead of root.
 @return: The item searched for.
 */
 template <typename DATA_TYPE>
-int BTree<DATA_TYPE>::search(const DATA_TYPE& item)
+DATA_TYPE BTree<DATA_TYPE>::searchAt(const DATA_TYPE& item, bool nearFinger)
+{
+    const DATA_TYPE* found = locateItem(item, nearFinger);
+    if (found == nullptr)
+    {
+        throw ItemNotFoundException(__LINE__, "Item was not found");
+    }
+    return *found;
+}
+
+/*
+Locate item uses findNode to locate a node where an item should be, and then loops across that node's vector until it hits the end
+or finds the searched item. When nearFinger is set, the node is located through findNodeNear, and either way the finger is left on the
+node that was searched. While writes are buffered, a key with a buffered write is answered from the write buffer before anything else.
+With the lookup cache on, a key found recently is returned from its cache entry without a descent, and a key found by a descent is entered
+in the cache. With the membership filter on, an item the filter rules out is reported missing without descending.
+
+@param[in]: An item to be searched for, and whether to start from the finger instead of root.
+@return: A pointer to the key in the tree, valid until the next change to the tree, or nullptr if item is not found.
+*/
+template <typename DATA_TYPE>
+const DATA_TYPE* BTree<DATA_TYPE>::locateItem(const DATA_TYPE& item, bool nearFinger)
 {
-    BTreeNode* searchNode = findNode(root, item);
+    if (!writeBuffer.empty())
+    {
+        int index = findMessage(item);
+        if (index < writeBuffer.size() && writeBuffer[index].key == item)
+        {
+            return writeBuffer[index].isInsert ? &writeBuffer[index].key : nullptr;
+        }
+    }
+
+    if (root == nullptr)
+    {
+        return nullptr;
+    }
+
+    BTreeCacheEntry* entry = nullptr;
+    uint32_t tag = 0;
+    if (!lookupCache.empty() && --cacheCountdown <= 0)
+    {
+        uint64_t hash = filterHash(item);
+        entry = &cacheEntry(hash);
+        tag = static_cast<uint32_t>(hash >> 32);
+        cacheCountdown = cacheStride;
+        bool hit = entry->node != nullptr && entry->tag == tag && entry->keyIndex < entry->node->keyVector.size()
+            && entry->node->keyVector[entry->keyIndex] == item;
+        sampleCache(hit);
+        if (hit)
+        {
+            BTREE_COUNT(cacheHits, 1);
+            finger = entry->node;
+            return &finger->keyVector[entry->keyIndex];
+        }
+    }
+
+    if (!mayContain(item))
+    {
+        return nullptr;
+    }
+
+    BTREE_COUNT(lookups, 1);
+    BTreeNode* searchNode = nearFinger ? findNodeNear(item) : findNode(root, item);
+    finger = searchNode;
     for (int i = 0; i < searchNode->keyVector.size(); i++)
     {
         if (searchNode->keyVector[i] == item)
         {
-            return searchNode->keyVector[i];
+            BTREE_COUNT(comparisons, i + 1);
+            if (entry != nullptr)
+            {
+                dropLookup(*entry);
+                entry->node = searchNode;
+                entry->tag = tag;
+                entry->keyIndex = i;
+                searchNode->cachedLookups++;
+            }
+            return &searchNode->keyVector[i];
         }
     }
+    BTREE_COUNT(comparisons, searchNode->keyVector.size());
 
-    throw ItemNotFoundException(__LINE__, "Item was not found");
+    return nullptr;
 }
 
 /*
@@ -759,6 +1733,7 @@ template <typename DATA_TYPE>
 typename BTree<DATA_TYPE>::BTreeNode* BTree<DATA_TYPE>::findNode(BTreeNode* startNode, const DATA_TYPE& item)
 {
     int i = 0;
+    BTREE_COUNT(nodesVisited, 1);
 
     if (startNode->childrenVector.empty())
     {
@@ -769,10 +1744,12 @@ typename BTree<DATA_TYPE>::BTreeNode* BTree<DATA_TYPE>::findNode(BTreeNode* star
     {
         if (startNode->keyVector[i] == item)
         {
+            BTREE_COUNT(comparisons, i + 1);
             return startNode;
         }
         else if (startNode->keyVector[i] > item)
         {
+            BTREE_COUNT(comparisons, i + 1);
             if (startNode->childrenVector[i] != nullptr)
             {
                 BTreeNode* returnNode = findNode(startNode->childrenVector[i], item);
@@ -785,16 +1762,1837 @@ typename BTree<DATA_TYPE>::BTreeNode* BTree<DATA_TYPE>::findNode(BTreeNode* star
         }
         i++;
     }
-    if (startNode->keyVector.back() < item)
+    BTREE_COUNT(comparisons, i);
+    //Every key of startNode is smaller than item once the loop ends, so the item belongs under the last child.
+    if (startNode->childrenVector.back() != nullptr)
+    {
+        BTreeNode* returnNode = findNode(startNode->childrenVector.back(), item);
+        return returnNode;
+    }
+    else
+    {
+        return startNode;
+    }
+}
+
+/*
+FindNodeNear locates the same node as findNode, but starts from the finger instead of root. If the item lies between the finger's own first
+and last keys, the finger's subtree holds it. Otherwise it climbs parent links and reads the separators on either side of each node it
+passes, which fence that node's range. The lowest node whose fences hold the item is where findNode takes over. An item equal to a
+separator makes the separator's node the start, since findNode stops there. The climb reaches the lowest subtree that holds both the
+finger and the item, so nearby keys usually stay within a level or two, but two neighbouring keys on either side of a separator high in
+the tree still climb up to it.
+
+@param[in]: An item to compare with items in node keyVectors.
+@return: The node where a B-Tree operation should occur.
+*/
+template <typename DATA_TYPE>
+typename BTree<DATA_TYPE>::BTreeNode* BTree<DATA_TYPE>::findNodeNear(const DATA_TYPE& item)
+{
+    if (finger == nullptr)
+    {
+        return findNode(root, item);
+    }
+
+    BTreeNode* startNode = finger;
+    if (!startNode->keyVector.empty() && !(item < startNode->keyVector.front()) && !(startNode->keyVector.back() < item))
+    {
+        return findNode(startNode, item);
+    }
+
+    //lowFenced and highFenced record whether the item is known to lie above the low fence and below the high fence of startNode.
+    bool lowFenced = false;
+    bool highFenced = false;
+    BTreeNode* node = startNode;
+    while (node->parent != nullptr && !(lowFenced && highFenced))
     {
-        if (startNode->childrenVector.back() != nullptr)
+        BTreeNode* parent = node->parent;
+        int childIndex = 0;
+        while (parent->childrenVector[childIndex] != node)
         {
-            BTreeNode* returnNode = findNode(startNode->childrenVector.back(), item);
-            return returnNode;
+            childIndex++;
         }
-        else
+        BTREE_COUNT(nodesVisited, 1);
+
+        if (!lowFenced && childIndex > 0)
         {
-            return startNode;
+            BTREE_COUNT(comparisons, 1);
+            if (parent->keyVector[childIndex - 1] < item)
+            {
+                lowFenced = true;
+            }
+            else
+            {
+                //The item is at or below the separator, so only parent's subtree can hold it, and its high fence lies above the separator.
+                startNode = parent;
+                highFenced = true;
+            }
+        }
+        if (!highFenced && childIndex < parent->keyVector.size())
+        {
+            BTREE_COUNT(comparisons, 1);
+            if (item < parent->keyVector[childIndex])
+            {
+                highFenced = true;
+            }
+            else
+            {
+                startNode = parent;
+                lowFenced = true;
+            }
+        }
+        node = parent;
+    }
+
+    return findNode(startNode, item);
+}
+
+/*
+RetireNode deletes a node that has been emptied by a merge or a root collapse. Any cached pointer to the node (the finger or the rightmost
+leaf) is moved onto the node that absorbed its keys, and the node is dropped from the dirty and overflow lists, so nothing points at freed
+memory. Its ancestors lose it from their subtree node counts.
+
+@param[in]: The node being deleted, and the node that took over its keys.
+@return: The B-Tree with one less node.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::retireNode(BTreeNode* node, BTreeNode* replacement)
+{
+    if (finger == node)
+    {
+        finger = replacement;
+    }
+    if (rightmostLeaf == node)
+    {
+        rightmostLeaf = replacement;
+    }
+    if (node->dirty)
+    {
+        unmarkDirty(node);
+    }
+    if (node->overflowQueued)
+    {
+        overflowNodes.erase(std::find(overflowNodes.begin(), overflowNodes.end(), node));
+    }
+    if (node->parent != nullptr)
+    {
+        adjustCounts(node->parent, 0, -1);
+    }
+
+    deleteNode(node);
+    nodeCount--;
+}
+
+/*
+UnmarkDirty takes a dirty node off the dirty list. An entry below dirtyFloor moves the floor down with it, so the entries above the floor
+stay the same.
+
+@param[in]: A node that is on the dirty list.
+@return: The node no longer marked dirty.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::unmarkDirty(BTreeNode* node)
+{
+    int index = std::find(dirtyNodes.begin(), dirtyNodes.end(), node) - dirtyNodes.begin();
+    if (index < dirtyFloor)
+    {
+        dirtyFloor--;
+    }
+    dirtyNodes.erase(dirtyNodes.begin() + index);
+    node->dirty = false;
+}
+
+/*
+Recount rebuilds a node's subtree counts from its own keys and the counts of its children. The split, borrow and merge functions call it on
+every node whose keys or children they moved, which costs O(fanout) on top of the vector shifts those functions already do.
+
+@param[in]: A node whose keys or children have just changed.
+@return: The node with a correct subtreeCount and subtreeNodes.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::recount(BTreeNode* node)
+{
+    node->subtreeCount = node->keyVector.size();
+    node->subtreeNodes = 1;
+    for (int i = 0; i < node->childrenVector.size(); i++)
+    {
+        node->subtreeCount += node->childrenVector[i]->subtreeCount;
+        node->subtreeNodes += node->childrenVector[i]->subtreeNodes;
+    }
+}
+
+/*
+AdjustCounts adds delta to the subtree count of a node and every one of its ancestors. Insert and remove call it once per key, before any
+restructuring, so the counts are already correct when resolveOverflow or resolveUnderflow recount the nodes they touch. A split or merge
+passes nodeDelta instead, for the node it added under, or removed from, the parent.
+
+@param[in]: The node a key was added to or removed from, the change in key count, and the change in node count.
+@return: The B-Tree with subtree counts updated along the path to root.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::adjustCounts(BTreeNode* node, int delta, int nodeDelta)
+{
+    while (node != nullptr)
+    {
+        node->subtreeCount += delta;
+        node->subtreeNodes += nodeDelta;
+        node = node->parent;
+    }
+}
+
+/*
+CountBelow walks a single path from root towards item, adding up every key and whole child subtree that sits to the left of the path.
+It backs both rank and countRange.
+
+@param[in]: An item to count up to, and whether a key equal to item is counted as well.
+@return: The number of keys smaller than item, or smaller than or equal to item when inclusive is set.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::countBelow(const DATA_TYPE& item, bool inclusive)
+{
+    int total = 0;
+    BTreeNode* node = root;
+
+    while (node != nullptr)
+    {
+        bool isLeaf = node->childrenVector.empty();
+        int i = 0;
+
+        while (i < node->keyVector.size() && node->keyVector[i] < item)
+        {
+            if (!isLeaf)
+            {
+                total += node->childrenVector[i]->subtreeCount;
+            }
+            total++;
+            i++;
+        }
+
+        if (i < node->keyVector.size() && node->keyVector[i] == item)
+        {
+            if (!isLeaf)
+            {
+                total += node->childrenVector[i]->subtreeCount;
+            }
+            if (inclusive)
+            {
+                total++;
+            }
+            return total;
+        }
+
+        node = isLeaf ? nullptr : node->childrenVector[i];
+    }
+
+    return total;
+}
+
+/*
+Select finds the k-th smallest key, counting from 0, by comparing k against subtree counts and descending into the one child that must
+hold it. Select(count() / 2) is the median, and percentiles follow the same way. If k is out of range, an exception is thrown. Buffered
+writes are flushed first.
+
+@param[in]: The zero based rank of the key to return.
+@return: The key with exactly k smaller keys in the tree.
+*/
+template <typename DATA_TYPE>
+DATA_TYPE BTree<DATA_TYPE>::select(int k)
+{
+    if (!writeBuffer.empty())
+    {
+        drainWrites();
+    }
+
+    if (root == nullptr || k < 0 || k >= root->subtreeCount)
+    {
+        throw ItemNotFoundException(__LINE__, "No item exists at the requested rank");
+    }
+
+    BTreeNode* node = root;
+    while (!node->childrenVector.empty())
+    {
+        int i = 0;
+        for (; i < node->keyVector.size(); i++)
+        {
+            int leftCount = node->childrenVector[i]->subtreeCount;
+            if (k < leftCount)
+            {
+                break;
+            }
+            if (k == leftCount)
+            {
+                return node->keyVector[i];
+            }
+            k -= leftCount + 1;
+        }
+        node = node->childrenVector[i];
+    }
+
+    return node->keyVector[k];
+}
+
+/*
+HandleUnderflow is called by remove and the merge functions whenever a node falls below the minimum key count. Normally it resolves the
+underflow straight away. With lazy rebalancing or incremental restructuring on, a node that still holds at least lowWatermark keys is only
+marked dirty, and the borrow or merge is left for compact.
+
+@param[in]: A node that has underflow.
+@return: The B-Tree either restructured, or with the node queued for compaction.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::handleUnderflow(BTreeNode* underNode)
+{
+    if ((lazyRebalance || restructureBudget > 0) && underNode->keyVector.size() >= lowWatermark)
+    {
+        if (!underNode->dirty && underNode->parent != nullptr)
+        {
+            underNode->dirty = true;
+            dirtyNodes.push_back(underNode);
         }
+        return;
+    }
+
+    resolveUnderflow(underNode);
+}
+
+/*
+SetLazyRebalance switches between eager and relaxed deletion. In relaxed mode, remove tolerates underflowed nodes as long as they keep at
+least watermark keys (never fewer than 1), which stops alternating inserts and deletes near the minimum from thrashing between splits and
+merges. Turning the mode off compacts every dirty node so the tree is a regular B-Tree again.
+
+@param[in]: Whether relaxed deletion is on, and the key count below which underflow is still resolved immediately.
+@return: The B-Tree with the new deletion mode.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::setLazyRebalance(bool enabled, int watermark)
+{
+    lazyRebalance = enabled;
+    lowWatermark = watermark < 1 ? 1 : watermark;
+
+    if (!enabled)
+    {
+        compact();
+    }
+}
+
+/*
+Compact resolves the underflow of dirty nodes in a batch, newest first, and is meant to be called from an idle loop or between requests.
+A merge can push its parent under the minimum, in which case the parent joins the dirty list and is handled in the same pass. Nodes that
+were refilled by inserts since they were marked are simply dropped from the list.
+
+@param[in]: The largest number of dirty nodes to handle, or -1 to handle all of them.
+@return: The number of dirty nodes still waiting.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::compact(int budget)
+{
+    int handled = 0;
+
+    while (dirtyNodes.size() > dirtyFloor && (budget < 0 || handled < budget))
+    {
+        BTreeNode* node = dirtyNodes.back();
+        dirtyNodes.pop_back();
+        node->dirty = false;
+
+        if (node->parent != nullptr && node->keyVector.size() < (MAGNITUDE - 1) / 2)
+        {
+            resolveUnderflow(node);
+        }
+        handled++;
+    }
+
+    return dirtyNodes.size();
+}
+
+/*
+HandleOverflow is called by resolveOverflow when a split pushes the parent over MAGNITUDE - 1 keys. Normally the parent is split straight
+away, which can cascade to root. With incremental restructuring on, the parent is queued instead, and keeps the extra keys until a later
+operation splits it.
+
+@param[in]: A node that has overflowed, and whether the overflow came from an append onto the right edge of the tree.
+@return: The B-Tree either restructured, or with the node queued for a later split.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::handleOverflow(BTreeNode* overNode, bool appending)
+{
+    if (restructureBudget > 0)
+    {
+        if (!overNode->overflowQueued)
+        {
+            overNode->overflowQueued = true;
+            overflowNodes.push_back(overNode);
+        }
+        return;
+    }
+
+    resolveOverflow(overNode, appending);
+}
+
+/*
+SetIncrementalRestructure spreads split cascades over later operations. With a budget above 0, an operation still splits or fixes the
+underflow of the node it touched, but a parent that this pushes over MAGNITUDE - 1 keys is queued instead of split, and a parent pushed
+under the minimum is marked dirty. Each insert and remove then spends up to budget steps on queued work: splits of queued nodes, oldest
+first, then compaction of dirty nodes. A split never cascades to root within one call, but the work of one operation is not bounded by a
+constant: the underflow fix at the touched node can still merge, a compaction step can borrow several keys or merge, and splitting a node
+that grew while it waited in the queue costs time in proportion to its size. A budget of 0 turns the mode off and finishes all queued work.
+
+@param[in]: The number of queued restructuring steps each operation may do, or 0 for classic cascading.
+@return: The B-Tree with the new restructuring mode.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::setIncrementalRestructure(int budget)
+{
+    restructureBudget = budget < 0 ? 0 : budget;
+
+    if (restructureBudget == 0)
+    {
+        splitQueued(-1);
+
+        if (!lazyRebalance)
+        {
+            compact();
+        }
+    }
+}
+
+/*
+StepDeferredWork runs at the end of every insert and remove while incremental restructuring is on. It spends the per operation budget on
+queued overflows first, since an overflowed node keeps growing, and then on dirty underflowed nodes through compact.
+
+@param[in]: Nothing.
+@return: The B-Tree with up to restructureBudget queued nodes fixed.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::stepDeferredWork()
+{
+    if (restructureBudget <= 0)
+    {
+        return;
+    }
+
+    int steps = splitQueued(restructureBudget);
+    if (steps < restructureBudget)
+    {
+        compact(restructureBudget - steps);
+    }
+}
+
+/*
+SplitQueued takes nodes off the front of the overflow queue and splits those still over MAGNITUDE - 1 keys. A split that leaves the node
+or its parent too large queues them again at the back.
+
+@param[in]: The largest number of nodes to take off the queue, or -1 to empty it.
+@return: The number of nodes taken off the queue.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::splitQueued(int budget)
+{
+    int steps = 0;
+    while (!overflowNodes.empty() && (budget < 0 || steps < budget))
+    {
+        BTreeNode* node = overflowNodes.front();
+        overflowNodes.pop_front();
+        node->overflowQueued = false;
+        if (node->keyVector.size() > MAGNITUDE - 1)
+        {
+            resolveOverflow(node);
+        }
+        steps++;
+    }
+    return steps;
+}
+
+/*
+SetWriteBuffer switches buffered write mode on or off. With a batch above 0, insert and remove only add a message to the write buffer, which
+is sorted by key and keeps one message per key. Once it holds more than batch messages, each write also applies the buffered messages
+bound for one leaf, taking the leaves in key order and wrapping around, so a leaf takes all of its buffered messages in one descent and one
+merge, and a key written again before it is applied costs no descent at all. A write pays a binary search and a shift of the buffer on top
+of that, and lookups search the buffer first, so with writes spread evenly over many more leaves than batch the mode runs at about the
+speed of classic writes for int keys and somewhat slower for string keys. It pays off when writes cluster on few leaves or repeat keys.
+The buffer is the only memory it adds, and a write never applies more than one leaf's messages, so latency stays that of classic writes.
+Insert and remove do not throw in this mode, and count, rank, countRange, select and scan apply every buffered write first. A batch of 0
+turns the mode off and applies every buffered write.
+
+@param[in]: The number of messages the write buffer holds before writes start applying them, or 0 for classic writes.
+@return: The B-Tree with the new write mode.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::setWriteBuffer(int batch)
+{
+    writeBufferBatch = batch < 0 ? 0 : batch;
+
+    if (writeBufferBatch == 0)
+    {
+        drainWrites();
+    }
+}
+
+/*
+FlushWrites applies every buffered write through drainWrites, and reports how many buffered writes turned out to change nothing since the
+previous flushWrites: inserts of keys already in the tree and removes of missing keys, which throw in every other mode. Each is counted
+against the tree as it stands when the write is applied, and a write replaced by a newer one of the same kind for the same key is counted
+as well. An out of date membership filter is rebuilt afterwards.
+
+@param[in]: Nothing.
+@return: The number of buffered writes dropped since the previous call.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::flushWrites()
+{
+    drainWrites();
+    refreshFilter();
+    int dropped = unreportedDrops;
+    unreportedDrops = 0;
+    return dropped;
+}
+
+/*
+DrainWrites applies every buffered message in key order, one leaf's run at a time, and empties the write buffer. Count, rank, countRange,
+select and scan call it first, since subtree counts only include applied writes.
+
+@param[in]: Nothing.
+@return: The B-Tree with no buffered writes left.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::drainWrites()
+{
+    int i = 0;
+    while (i < writeBuffer.size())
+    {
+        i = applyRun(i);
+    }
+    writeBuffer.clear();
+    sweepIndex = 0;
+}
+
+/*
+DropWrite counts a buffered write that changed nothing, for stats and for the next flushWrites.
+
+@param[in]: Nothing.
+@return: The drop counters moved on by one.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::dropWrite()
+{
+    droppedWrites++;
+    unreportedDrops++;
+}
+
+/*
+BufferWrite adds an insert or remove message for item to the write buffer, replacing any older message for the same key. When the buffer
+goes over writeBufferBatch messages, the run at sweepIndex is applied and taken out of the buffer, and sweepIndex is left on the run after
+it. A new insert is marked in the membership filter straight away, so lookups cannot rule out a key that is still buffered.
+
+@param[in]: An item to insert or remove, and whether it is an insert.
+@return: The B-Tree with the write buffered, and at most one leaf's run of older writes applied.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::bufferWrite(const DATA_TYPE& item, bool isInsert)
+{
+    int index = findMessage(item);
+    if (index < writeBuffer.size() && writeBuffer[index].key == item)
+    {
+        if (writeBuffer[index].isInsert == isInsert)
+        {
+            dropWrite();
+        }
+        else if (isInsert)
+        {
+            filterMark(item);
+        }
+        writeBuffer[index].isInsert = isInsert;
+    }
+    else
+    {
+        if (isInsert)
+        {
+            filterMark(item);
+        }
+        BTreeMessage message = { item, isInsert };
+        writeBuffer.insert(writeBuffer.begin() + index, message);
+        if (index < sweepIndex)
+        {
+            sweepIndex++;
+        }
+    }
+
+    if (writeBuffer.size() > writeBufferBatch)
+    {
+        if (sweepIndex >= writeBuffer.size())
+        {
+            sweepIndex = 0;
+        }
+        int next = applyRun(sweepIndex);
+        writeBuffer.erase(writeBuffer.begin() + sweepIndex, writeBuffer.begin() + next);
+    }
+}
+
+/*
+ApplyRun applies the buffered messages from first that are bound for the same leaf. A run is applied to its leaf by applyToLeaf, and a
+message applyToLeaf leaves alone goes through the same insertItem and removeItem that classic writes use. The messages stay in the buffer
+for the caller to erase.
+
+@param[in]: The index in writeBuffer of the first message of the run.
+@return: The index after the run.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::applyRun(int first)
+{
+    int next = nodeCount == 0 ? first : applyToLeaf(first);
+    if (next > first)
+    {
+        return next;
+    }
+
+    const BTreeMessage& message = writeBuffer[first];
+    if (!(message.isInsert ? insertItem(message.key, false) : removeItem(message.key, false)))
+    {
+        dropWrite();
+    }
+    return first + 1;
+}
+
+/*
+ApplyToLeaf finds the leaf for the message at first, and takes the following messages into the run while their keys are no larger than the
+leaf's last key, which keeps them inside the leaf's range without reading the separators above it. A run of one is applied in place, and a
+longer run is merged with the leaf's keys by mergeRun, after which the leaf is split or rebalanced as a whole. A message whose key sits in
+an internal node, or lies past the leaf's last key, is left to insertItem and removeItem, so that delete by copy, the append fast path and
+asymmetric splits still apply.
+
+@param[in]: The index in writeBuffer of the first message of the run.
+@return: The index after the run, or first if the message should be applied on its own.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::applyToLeaf(int first)
+{
+    const DATA_TYPE& firstKey = writeBuffer[first].key;
+    if (rightmostLeaf->keyVector.empty() || rightmostLeaf->keyVector.back() < firstKey)
+    {
+        return first;
+    }
+
+    BTREE_COUNT(lookups, 1);
+    BTreeNode* leaf = findNode(root, firstKey);
+    if (!leaf->childrenVector.empty() || leaf->keyVector.empty() || leaf->keyVector.back() < firstKey)
+    {
+        return first;
+    }
+
+    int last = first + 1;
+    while (last < writeBuffer.size() && !(leaf->keyVector.back() < writeBuffer[last].key))
+    {
+        last++;
+    }
+
+    int delta = 0;
+    if (last - first == 1)
+    {
+        //A run of one, the usual case for random writes, is applied in place rather than by rebuilding the leaf.
+        int keyIndex = lower_bound(leaf->keyVector.begin(), leaf->keyVector.end(), firstKey) - leaf->keyVector.begin();
+        bool present = leaf->keyVector[keyIndex] == firstKey;
+        if (present == writeBuffer[first].isInsert)
+        {
+            dropWrite();
+        }
+        else if (present)
+        {
+            leaf->keyVector.erase(leaf->keyVector.begin() + keyIndex);
+            delta = -1;
+            filterRemoved++;
+        }
+        else
+        {
+            leaf->keyVector.insert(leaf->keyVector.begin() + keyIndex, firstKey);
+            filterAdd(firstKey);
+            delta = 1;
+        }
+    }
+    else
+    {
+        delta = mergeRun(leaf, first, last);
+    }
+
+    finger = leaf;
+    appendRun = 0;
+    adjustCounts(leaf, delta);
+    totalKeyCount += delta;
+
+    if (leaf->keyVector.size() > MAGNITUDE - 1)
+    {
+        resolveOverflow(leaf);
+    }
+    else if (leaf->keyVector.size() < (MAGNITUDE - 1) / 2)
+    {
+        handleUnderflow(leaf);
+    }
+
+    stepDeferredWork();
+    return last;
+}
+
+/*
+MergeRun merges a run of buffered messages bound for one leaf with the leaf's keys in one pass through keyScratch, moving keys rather than
+copying them. Inserts of keys already present and removes of missing keys drop out of the merge.
+
+@param[in]: The leaf, and the range of writeBuffer holding its run.
+@return: The change in the leaf's key count.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::mergeRun(BTreeNode* leaf, int first, int last)
+{
+    if (keyScratch.get_allocator() != leaf->keyVector.get_allocator())
+    {
+        keyScratch = KeyVector(leaf->keyVector.get_allocator());
+    }
+    keyScratch.clear();
+    int keyIndex = 0;
+    int delta = 0;
+    for (int i = first; i < last; i++)
+    {
+        const BTreeMessage& message = writeBuffer[i];
+        while (keyIndex < leaf->keyVector.size() && leaf->keyVector[keyIndex] < message.key)
+        {
+            keyScratch.push_back(std::move(leaf->keyVector[keyIndex++]));
+        }
+
+        bool present = keyIndex < leaf->keyVector.size() && leaf->keyVector[keyIndex] == message.key;
+        if (present == message.isInsert)
+        {
+            dropWrite();
+        }
+        if (present && message.isInsert)
+        {
+            keyScratch.push_back(std::move(leaf->keyVector[keyIndex]));
+        }
+        else if (message.isInsert)
+        {
+            keyScratch.push_back(message.key);
+            filterAdd(message.key);
+            delta++;
+        }
+        else if (present)
+        {
+            delta--;
+            filterRemoved++;
+        }
+        keyIndex += present ? 1 : 0;
+    }
+    keyScratch.insert(keyScratch.end(), make_move_iterator(leaf->keyVector.begin() + keyIndex), make_move_iterator(leaf->keyVector.end()));
+    leaf->keyVector.swap(keyScratch);
+    return delta;
+}
+
+/*
+FindMessage binary searches the write buffer, which is kept sorted by key.
+
+@param[in]: The key to look for in the write buffer.
+@return: The index of the first message whose key is not smaller than key.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::findMessage(const DATA_TYPE& key)
+{
+    int low = 0;
+    int high = writeBuffer.size();
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (writeBuffer[mid].key < key)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*
+Stats walks the tree one level at a time and fills a BTreeStats snapshot with the height, per level node and key counts, per level fill
+histograms, and the bytes held by nodes and their vectors. It describes this tree only; the hot path counters cover every tree in the
+process and are read through counterSnapshot. The walk is O(n), so it is meant for monitoring and benchmarks rather than the request path.
+
+@param[in]: Nothing.
+@return: A BTreeStats snapshot of the tree as it is now.
+*/
+template <typename DATA_TYPE>
+BTreeStats BTree<DATA_TYPE>::stats()
+{
+    BTreeStats snapshot;
+    snapshot.nodeCount = nodeCount;
+    snapshot.keyCount = totalKeyCount;
+    snapshot.pendingRestructures = pendingRestructures();
+    snapshot.pendingWrites = writeBuffer.size();
+    snapshot.droppedWrites = droppedWrites;
+    snapshot.filterBytes = filterWords.size() * sizeof(uint32_t);
+    snapshot.lookupCacheBytes = lookupCache.size() * sizeof(BTreeCacheEntry);
+
+    vector<BTreeNode*> level;
+    if (root != nullptr)
+    {
+        level.push_back(root);
+    }
+
+    while (!level.empty())
+    {
+        BTreeLevelStats levelStats;
+        vector<BTreeNode*> nextLevel;
+
+        for (int i = 0; i < level.size(); i++)
+        {
+            BTreeNode* node = level[i];
+            int bucket = MAGNITUDE > 1 ? node->keyVector.size() * 10 / (MAGNITUDE - 1) : 9;
+
+            levelStats.nodes++;
+            levelStats.keys += node->keyVector.size();
+            levelStats.fillHistogram[bucket > 9 ? 9 : bucket]++;
+            snapshot.bytesUsed += sizeof(BTreeNode) + node->keyVector.capacity() * sizeof(DATA_TYPE)
+                + node->childrenVector.capacity() * sizeof(BTreeNode*);
+            nextLevel.insert(nextLevel.end(), node->childrenVector.begin(), node->childrenVector.end());
+        }
+
+        snapshot.levels.push_back(levelStats);
+        level.swap(nextLevel);
+    }
+
+    snapshot.height = snapshot.levels.size();
+    return snapshot;
+}
+
+/*
+Join moves every key of other into this tree, and leaves other empty. When all keys of other are larger than all keys of this tree, the
+smallest key of other is taken out as a separator and the two trees are linked through joinWith, which only touches the nodes along the
+seam between them, so the cost is O(log n) however many keys move. Trees whose key ranges overlap are merged through unionWith instead,
+in linear time. Buffered writes and queued splits of both trees are finished first, while nodes left dirty by lazy removes are carried
+over to this tree's dirty list rather than compacted. The membership filter of this tree is dropped on the O(log n) path, since
+rebuilding it would cost O(n), and lookups skip it until a later write rebuilds it.
+
+@param[in]: The tree whose keys are moved into this one.
+@return: The B-Tree holding the keys of both trees, and other empty.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::join(BTree& other)
+{
+    if (&other == this)
+    {
+        return;
+    }
+
+    drainWrites();
+    splitQueued(-1);
+    other.drainWrites();
+    other.splitQueued(-1);
+    dropFilter();
+    other.dropFilter();
+
+    if (other.totalKeyCount == 0)
+    {
+        other.clearTree();
+        return;
+    }
+    if (totalKeyCount == 0)
+    {
+        takeTree(other);
+        return;
+    }
+
+    BTreeNode* firstLeaf = other.root;
+    while (!firstLeaf->childrenVector.empty())
+    {
+        firstLeaf = firstLeaf->childrenVector.front();
+    }
+
+    if (!(rightmostLeaf->keyVector.back() < firstLeaf->keyVector.front()))
+    {
+        combineWith(other, 1);
+        other.clearTree();
+        return;
+    }
+
+    DATA_TYPE separator = firstLeaf->keyVector.front();
+    other.removeItem(separator, false);
+    joinWith(separator, other);
+}
+
+/*
+SplitAt moves every key greater than or equal to key into right, and keeps the smaller ones. It cuts each node on the path from root
+towards key in two: the left part keeps the keys and children below the cut, and a new node takes those above it. The key at the cut
+on each level is kept as a separator, and the parts are then joined back together bottom up through joinWith, the left parts into one
+tree and the right parts into another. The heights of the parts grow by about one level per join, so the whole split relinks O(log n)
+nodes, and subtree node counts give the node count of every part without walking it. The keys are handed to right through join, so if
+right already holds keys they are kept as well. Nodes left dirty by lazy removes are not compacted: those on the cut path are cut like any
+other, and the rest are handed to the part holding them, so they end up on the dirty list of whichever tree takes their keys. The
+membership filter of this tree still covers the keys that stay, and counts the moved ones as removed.
+
+@param[in]: The smallest key to move, and the tree that receives the moved keys.
+@return: The B-Tree holding only keys smaller than key, and right holding the rest.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::splitAt(const DATA_TYPE& key, BTree& right)
+{
+    if (&right == this)
+    {
+        return;
+    }
+
+    drainWrites();
+    splitQueued(-1);
+    if (totalKeyCount == 0)
+    {
+        return;
+    }
+
+    vector<BTreeNode*> dirty;
+    dirty.swap(dirtyNodes);
+    vector<BTreeNode*> leftParts;
+    vector<BTreeNode*> rightParts;
+    vector<DATA_TYPE> leftSeparators;
+    vector<DATA_TYPE> rightSeparators;
+    BTreeNode* leftBottom = nullptr;
+    BTreeNode* rightBottom = nullptr;
+    BTreeNode* node = root;
+    resetTree();
+
+    while (node != nullptr)
+    {
+        if (node->dirty)
+        {
+            dirty.erase(std::find(dirty.begin(), dirty.end(), node));
+            node->dirty = false;
+        }
+
+        int keyCount = node->keyVector.size();
+        int i = 0;
+        while (i < keyCount && node->keyVector[i] < key)
+        {
+            i++;
+        }
+
+        if (node->childrenVector.empty())
+        {
+            rightBottom = newNode(true);
+            rightBottom->keyVector.assign(node->keyVector.begin() + i, node->keyVector.end());
+            node->keyVector.erase(node->keyVector.begin() + i, node->keyVector.end());
+            leftBottom = node;
+            break;
+        }
+
+        bool keyFound = i < keyCount && node->keyVector[i] == key;
+        BTreeNode* child = node->childrenVector[i];
+
+        if (i < keyCount)
+        {
+            BTreeNode* rightPart = newNode(false);
+            rightPart->keyVector.assign(node->keyVector.begin() + (i + 1), node->keyVector.end());
+            rightPart->childrenVector.assign(node->childrenVector.begin() + (i + 1), node->childrenVector.end());
+            for (int j = 0; j < rightPart->childrenVector.size(); j++)
+            {
+                rightPart->childrenVector[j]->parent = rightPart;
+            }
+            rightParts.push_back(rightPart);
+            rightSeparators.push_back(node->keyVector[i]);
+        }
+
+        if (keyFound)
+        {
+            node->keyVector.erase(node->keyVector.begin() + i, node->keyVector.end());
+            node->childrenVector.erase(node->childrenVector.begin() + (i + 1), node->childrenVector.end());
+            leftBottom = node;
+            break;
+        }
+
+        if (i > 0)
+        {
+            leftSeparators.push_back(node->keyVector[i - 1]);
+            node->keyVector.erase(node->keyVector.begin() + (i - 1), node->keyVector.end());
+            node->childrenVector.erase(node->childrenVector.begin() + i, node->childrenVector.end());
+            leftParts.push_back(node);
+        }
+        else
+        {
+            deleteNode(node);
+        }
+        node = child;
+    }
+
+    //Every dirty node left is off the cut path, so it lies wholly inside one part, found from its first key and the separators: left
+    //parts hold keys below their separator, right parts keys above theirs, and the bottom parts whatever is left on each side.
+    vector<vector<BTreeNode*>> leftDirty(leftParts.size() + 1);
+    vector<vector<BTreeNode*>> rightDirty(rightParts.size() + 1);
+    for (int i = 0; i < dirty.size(); i++)
+    {
+        const DATA_TYPE& first = dirty[i]->keyVector.front();
+        int j = 0;
+        if (first < key)
+        {
+            while (j < leftSeparators.size() && leftSeparators[j] < first)
+            {
+                j++;
+            }
+            leftDirty[j].push_back(dirty[i]);
+        }
+        else
+        {
+            while (j < rightSeparators.size() && first < rightSeparators[j])
+            {
+                j++;
+            }
+            rightDirty[j].push_back(dirty[i]);
+        }
+    }
+
+    BTree<DATA_TYPE> leftTree(compare);
+    BTree<DATA_TYPE> rightTree(compare);
+    BTree<DATA_TYPE> part(compare);
+
+    leftTree.adoptRoot(leftBottom);
+    leftTree.dirtyNodes.swap(leftDirty.back());
+    for (int i = leftParts.size() - 1; i >= 0; i--)
+    {
+        part.adoptRoot(leftParts[i]);
+        part.dirtyNodes.swap(leftDirty[i]);
+        part.joinWith(leftSeparators[i], leftTree);
+        leftTree.takeTree(part);
+    }
+
+    rightTree.adoptRoot(rightBottom);
+    rightTree.dirtyNodes.swap(rightDirty.back());
+    for (int i = rightParts.size() - 1; i >= 0; i--)
+    {
+        part.adoptRoot(rightParts[i]);
+        part.dirtyNodes.swap(rightDirty[i]);
+        rightTree.joinWith(rightSeparators[i], part);
+    }
+
+    filterRemoved += rightTree.totalKeyCount;
+    takeTree(leftTree);
+    right.join(rightTree);
+}
+
+/*
+JoinWith links this tree, separator and other into one tree, when every key of this tree is smaller than separator and every key of other
+is larger. The lower tree is hung off the edge of the taller one at the level where their heights match, with separator as the key
+between them, and the node it was added to is split if it overflows. The nodes along the seam, which used to be on the right edge of the
+left tree or were the root of a tree, can hold fewer than the minimum number of keys, so they are marked dirty and compact fixes them
+bottom up. Other's dirty and overflow lists move over with its nodes, and dirtyFloor keeps compact to the seam, so nodes left dirty by
+lazy removes in either tree stay queued instead of being compacted here. Other is left empty.
+
+@param[in]: A key between the two trees, and the tree holding the larger keys.
+@return: The B-Tree holding the keys of both trees and separator.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::joinWith(const DATA_TYPE& separator, BTree& other)
+{
+    if (other.totalKeyCount == 0)
+    {
+        other.clearTree();
+        insertItem(separator, false);
+        return;
+    }
+    if (totalKeyCount == 0)
+    {
+        takeTree(other);
+        insertItem(separator, false);
+        return;
+    }
+
+    int leftHeight = height();
+    int rightHeight = other.height();
+    BTreeNode* otherRoot = other.root;
+    BTreeNode* seam = root;
+    BTreeNode* parent;
+
+    vector<BTreeNode*> seamNodes;
+
+    nodeCount += other.nodeCount;
+    totalKeyCount += other.totalKeyCount + 1;
+    rightmostLeaf = other.rightmostLeaf;
+    dirtyNodes.insert(dirtyNodes.end(), other.dirtyNodes.begin(), other.dirtyNodes.end());
+    overflowNodes.insert(overflowNodes.end(), other.overflowNodes.begin(), other.overflowNodes.end());
+    dirtyFloor = dirtyNodes.size();
+    other.resetTree();
+
+    if (leftHeight >= rightHeight)
+    {
+        for (int i = leftHeight - rightHeight; i > 0; i--)
+        {
+            seam = seam->childrenVector.back();
+        }
+
+        if (seam == root)
+        {
+            parent = newNode(false);
+            parent->childrenVector.push_back(root);
+            root->parent = parent;
+            root = parent;
+            nodeCount++;
+        }
+        else
+        {
+            parent = seam->parent;
+        }
+
+        parent->keyVector.push_back(separator);
+        parent->childrenVector.push_back(otherRoot);
+        otherRoot->parent = parent;
+        seamNodes.push_back(otherRoot);
+    }
+    else
+    {
+        parent = otherRoot;
+        for (int i = rightHeight - leftHeight - 1; i > 0; i--)
+        {
+            parent = parent->childrenVector.front();
+        }
+
+        parent->keyVector.insert(parent->keyVector.begin(), separator);
+        parent->childrenVector.insert(parent->childrenVector.begin(), root);
+        root->parent = parent;
+        root = otherRoot;
+    }
+
+    for (BTreeNode* node = parent; node != nullptr; node = node->parent)
+    {
+        recount(node);
+    }
+
+    for (BTreeNode* node = seam; node != nullptr; node = node->childrenVector.empty() ? nullptr : node->childrenVector.back())
+    {
+        seamNodes.push_back(node);
+    }
+    for (int i = 0; i < seamNodes.size(); i++)
+    {
+        if (seamNodes[i]->dirty)
+        {
+            unmarkDirty(seamNodes[i]);
+        }
+        seamNodes[i]->dirty = true;
+        dirtyNodes.push_back(seamNodes[i]);
+    }
+
+    finger = nullptr;
+    appendRun = 0;
+
+    if (parent->keyVector.size() > MAGNITUDE - 1)
+    {
+        resolveOverflow(parent);
+    }
+    compact();
+    dirtyFloor = 0;
+}
+
+/*
+CombineWith carries out unionWith, intersectWith and differenceWith, enumerated as cases 1 to 3. It walks both trees in order at the same
+time, each through a path of BTreePathSteps from its root, and merges the two sorted sequences into a fresh tree, which then replaces this
+one. Every key kept is larger than the one before, so the fresh tree is built through the append fast path of insertItem, which fills
+nodes without any descent, and no more than one path per tree is held besides it. A key held by both trees is kept as this tree's copy.
+The membership filter is rebuilt over the result.
+
+@param[in]: The tree to combine with, and which operation to carry out.
+@return: The B-Tree holding the union, intersection or difference of both trees.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::combineWith(BTree& other, int combineCase)
+{
+    if (&other == this)
+    {
+        if (combineCase == 3)
+        {
+            clearTree();
+        }
+        return;
+    }
+
+    settle();
+    other.settle();
+    filterWords.clear();
+
+    BTree result(compare);
+    result.hugePageNodes = hugePageNodes;
+    result.hugePageNumaNode = hugePageNumaNode;
+    vector<BTreePathStep> mine;
+    vector<BTreePathStep> theirs;
+    descendPath(mine, root);
+    descendPath(theirs, other.root);
+
+    while (!mine.empty() || (combineCase == 1 && !theirs.empty()))
+    {
+        if (combineCase == 2 && theirs.empty())
+        {
+            break;
+        }
+
+        const DATA_TYPE* myKey = mine.empty() ? nullptr : &mine.back().node->keyVector[mine.back().keyIndex];
+        const DATA_TYPE* theirKey = theirs.empty() ? nullptr : &theirs.back().node->keyVector[theirs.back().keyIndex];
+        if (theirKey == nullptr || (myKey != nullptr && *myKey < *theirKey))
+        {
+            if (combineCase != 2)
+            {
+                result.insertItem(*myKey, false);
+            }
+            advancePath(mine);
+        }
+        else if (myKey == nullptr || *theirKey < *myKey)
+        {
+            if (combineCase == 1)
+            {
+                result.insertItem(*theirKey, false);
+            }
+            advancePath(theirs);
+        }
+        else
+        {
+            if (combineCase != 3)
+            {
+                result.insertItem(*myKey, false);
+            }
+            advancePath(mine);
+            advancePath(theirs);
+        }
+    }
+
+    takeTree(result);
+    if (filterBitsPerKey > 0)
+    {
+        rebuildFilter();
+    }
+}
+
+/*
+DescendPath steps from node down the leftmost children to a leaf, and pushes each node onto path with its first key next. AdvancePath
+moves path on to the key after the current one: past a key of an internal node it descends the child to the right of it, and once a
+node has no keys left it is popped, so an empty path means the walk is over. Both leave path at the next key in order.
+
+@param[in]: The path to extend or advance, and for descendPath the node to start from.
+@return: path pointing at the next key in order, or empty once every key has been visited.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::descendPath(vector<BTreePathStep>& path, BTreeNode* node)
+{
+    while (node != nullptr)
+    {
+        BTreePathStep step = { node, 0 };
+        path.push_back(step);
+        node = node->childrenVector.empty() ? nullptr : node->childrenVector.front();
+    }
+    while (!path.empty() && path.back().keyIndex >= path.back().node->keyVector.size())
+    {
+        path.pop_back();
+    }
+}
+
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::advancePath(vector<BTreePathStep>& path)
+{
+    BTreeNode* node = path.back().node;
+    int keyIndex = ++path.back().keyIndex;
+    descendPath(path, node->childrenVector.empty() ? nullptr : node->childrenVector[keyIndex]);
+}
+
+/*
+SeekPath builds the path to the first key not less than item, as descendPath does to the first key of the tree. At every node it steps
+past the keys below item and descends the child before the first key that is not, and it stops early at a node holding item itself.
+
+@param[in]: An empty path, and the item to seek.
+@return: path pointing at the first key not less than item, or empty if every key is smaller.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::seekPath(vector<BTreePathStep>& path, const DATA_TYPE& item)
+{
+    BTreeNode* node = root;
+    while (node != nullptr)
+    {
+        int keyIndex = 0;
+        while (keyIndex < node->keyVector.size() && node->keyVector[keyIndex] < item)
+        {
+            keyIndex++;
+        }
+        BTREE_COUNT(comparisons, keyIndex + 1);
+        BTreePathStep step = { node, keyIndex };
+        path.push_back(step);
+        if (node->childrenVector.empty() || (keyIndex < node->keyVector.size() && node->keyVector[keyIndex] == item))
+        {
+            break;
+        }
+        node = node->childrenVector[keyIndex];
+    }
+    while (!path.empty() && path.back().keyIndex >= path.back().node->keyVector.size())
+    {
+        path.pop_back();
+    }
+}
+
+/*
+Scan copies up to limit keys in order into out, starting at the first key not less than low, as a range scan would read them. It walks
+one path from root like the set operations do, after flushing buffered writes.
+
+@param[in]: The lowest key to return, the most keys to return, and the vector to fill, which is cleared first.
+@return: The number of keys copied into out.
+*/
+template <typename DATA_TYPE>
+int BTree<DATA_TYPE>::scan(const DATA_TYPE& low, int limit, vector<DATA_TYPE>& out)
+{
+    out.clear();
+    if (!writeBuffer.empty())
+    {
+        drainWrites();
+    }
+
+    vector<BTreePathStep> path;
+    seekPath(path, low);
+    while (!path.empty() && out.size() < limit)
+    {
+        out.push_back(path.back().node->keyVector[path.back().keyIndex]);
+        advancePath(path);
+    }
+    return out.size();
+}
+
+/*
+Settle finishes all deferred work before a whole tree operation: buffered writes are flushed, queued overflows are split, and dirty nodes
+are compacted, so no node outside the tree's own lists is left half restructured when nodes move between trees.
+
+@param[in]: Nothing.
+@return: The B-Tree with no buffered writes or pending restructures.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::settle()
+{
+    drainWrites();
+    splitQueued(-1);
+    compact();
+}
+
+/*
+ResetTree makes the tree empty without deleting any node, after its nodes have been handed to another tree, and invalidates the lookup
+cache, whose entries may point at those nodes. ClearTree deletes them first. Neither changes the tree's modes.
+
+@param[in]: Nothing.
+@return: An empty B-Tree.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::resetTree()
+{
+    root = nullptr;
+    rightmostLeaf = nullptr;
+    finger = nullptr;
+    appendRun = 0;
+    nodeCount = 0;
+    totalKeyCount = 0;
+    writeBuffer.clear();
+    sweepIndex = 0;
+    dirtyNodes.clear();
+    overflowNodes.clear();
+    invalidateLookups();
+}
+
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::clearTree()
+{
+    invalidateLookups();
+    postOrderDelete(root);
+    resetTree();
+}
+
+/*
+TakeTree replaces the contents of this tree with the nodes of other, along with its dirty and overflow lists, and leaves other empty.
+
+@param[in]: The tree to take the nodes of.
+@return: The B-Tree holding other's keys.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::takeTree(BTree& other)
+{
+    clearTree();
+    root = other.root;
+    rightmostLeaf = other.rightmostLeaf;
+    nodeCount = other.nodeCount;
+    totalKeyCount = other.totalKeyCount;
+    dirtyNodes.swap(other.dirtyNodes);
+    overflowNodes.swap(other.overflowNodes);
+    other.resetTree();
+}
+
+/*
+AdoptRoot makes an empty tree out of a detached subtree, which splitAt cut out of another tree. A cut node left with no keys is dropped in
+favour of its only child, or left out entirely if it is a leaf. The node and key counts are read off the subtree counts.
+
+@param[in]: The root of the subtree, or nullptr for an empty tree.
+@return: A B-Tree holding the subtree.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::adoptRoot(BTreeNode* node)
+{
+    clearTree();
+
+    if (node != nullptr && node->keyVector.empty())
+    {
+        BTreeNode* child = node->childrenVector.empty() ? nullptr : node->childrenVector.front();
+        deleteNode(node);
+        node = child;
+    }
+    if (node == nullptr)
+    {
+        return;
+    }
+
+    node->parent = nullptr;
+    recount(node);
+    root = node;
+    rightmostLeaf = node;
+    while (!rightmostLeaf->childrenVector.empty())
+    {
+        rightmostLeaf = rightmostLeaf->childrenVector.back();
+    }
+    nodeCount = node->subtreeNodes;
+    totalKeyCount = node->subtreeCount;
+}
+
+/*
+SetMembershipFilter turns the membership filter on or off. With bitsPerKey above 0, search, searchNear and contains first ask a blocked
+Bloom filter over every key, built from hash, and an item it rules out is reported missing straight away instead of descending the tree.
+Each key sets one bit in each of the 8 words of one 32 byte block, so a lookup reads a single block. The filter is sized for twice the
+keys in the tree, so it takes between bitsPerKey and twice that many bits per key, and at 10 bits per key passes about 1% of absent keys.
+Inserts add their key as they happen, while growth and removals are caught up by a rebuild on the write side, at the next insert, remove
+or flushWrites once the filter is out of date, so no lookup pays for one. A bitsPerKey of 0 turns the filter off and frees it.
+
+@param[in]: The number of filter bits per key at full load, or 0 to turn the filter off, and a hash function for the keys.
+@return: The B-Tree with the new filter setting, and the filter built.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::setMembershipFilter(int bitsPerKey, size_t (*hash)(const DATA_TYPE& item))
+{
+    filterBitsPerKey = bitsPerKey < 0 || hash == nullptr ? 0 : bitsPerKey;
+    if (hash != nullptr)
+    {
+        hashItem = hash;
+    }
+    filterWords.clear();
+    filterWords.shrink_to_fit();
+    if (filterBitsPerKey > 0)
+    {
+        rebuildFilter();
+    }
+}
+
+/*
+MayContain asks the membership filter alone whether item could be in the tree. False means item is certainly absent, and true means it is
+present or a false positive. An out of date filter still holds every key, so it is used as it is, and never rebuilt here. Without a
+filter, or while a dropped one waits for its rebuild, the answer is always true.
+
+@param[in]: An item to look for.
+@return: False if item is not in the tree, true if it might be.
+*/
+template <typename DATA_TYPE>
+bool BTree<DATA_TYPE>::mayContain(const DATA_TYPE& item)
+{
+    if (filterBitsPerKey == 0 || filterWords.empty())
+    {
+        return true;
+    }
+
+    uint64_t hash = filterHash(item);
+    uint32_t* block = filterBlock(hash);
+    for (int i = 0; i < 8; i++)
+    {
+        if ((block[i] & filterMask(hash, i)) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Contains reports whether item is in the tree through locateItem, without the cost of an exception on a miss.
+
+@param[in]: An item to look for.
+@return: True if item is in the tree.
+*/
+template <typename DATA_TYPE>
+bool BTree<DATA_TYPE>::contains(const DATA_TYPE& item)
+{
+    return locateItem(item, false) != nullptr;
+}
+
+/*
+ContainsNear is contains starting from the finger, the non-throwing counterpart of searchNear.
+
+@param[in]: An item to look for.
+@return: True if item is in the tree.
+*/
+template <typename DATA_TYPE>
+bool BTree<DATA_TYPE>::containsNear(const DATA_TYPE& item)
+{
+    return locateItem(item, true) != nullptr;
+}
+
+/*
+FilterHash runs the hash from main through a 64 bit finalizer, since hashes such as the identity hash of int leave most bits unmixed. The
+upper half picks the filter block and the lower half the bits inside it. The lowest bits pick the lookup cache entry, and the upper half
+is its tag.
+
+@param[in]: An item to hash.
+@return: A well mixed 64 bit hash of item.
+*/
+template <typename DATA_TYPE>
+uint64_t BTree<DATA_TYPE>::filterHash(const DATA_TYPE& item)
+{
+    uint64_t hash = hashItem(item);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/*
+FilterBlock maps the upper half of a hash onto one of the filter's blocks, by multiplying instead of taking a remainder. FilterMask picks
+the bit for one word of the block from the lower half, multiplied by a different odd constant for each word.
+
+@param[in]: A hash from filterHash, and for filterMask the word of the block.
+@return: The first word of the block, or the mask of the bit in the given word.
+*/
+template <typename DATA_TYPE>
+uint32_t* BTree<DATA_TYPE>::filterBlock(uint64_t hash)
+{
+    return &filterWords[((hash >> 32) * (filterWords.size() / 8)) >> 32 << 3];
+}
+
+template <typename DATA_TYPE>
+uint32_t BTree<DATA_TYPE>::filterMask(uint64_t hash, int word)
+{
+    static const uint32_t salts[8] = { 0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+    return 1U << ((static_cast<uint32_t>(hash) * salts[word]) >> 27);
+}
+
+/*
+FilterAdd counts a key that has just been inserted, whether or not a filter is built, so that a dropped filter is rebuilt after a bounded
+number of inserts, and sets its bits through filterMark. FilterMark sets the bits alone: a buffered insert is marked when it is buffered,
+so that lookups cannot rule it out, and only counted once it is applied.
+
+@param[in]: An item being inserted.
+@return: The filter with item added.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::filterAdd(const DATA_TYPE& item)
+{
+    filterEntries++;
+    filterMark(item);
+}
+
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::filterMark(const DATA_TYPE& item)
+{
+    if (filterWords.empty())
+    {
+        return;
+    }
+
+    uint64_t hash = filterHash(item);
+    uint32_t* block = filterBlock(hash);
+    for (int i = 0; i < 8; i++)
+    {
+        block[i] |= filterMask(hash, i);
+    }
+}
+
+/*
+RebuildFilter sizes a new membership filter for twice the keys in the tree, buffered inserts included, adds every key to it, and marks
+every buffered insert.
+
+@param[in]: Nothing.
+@return: A filter holding exactly the current keys.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::rebuildFilter()
+{
+    filterCapacity = 2 * (static_cast<long long>(totalKeyCount) + writeBuffer.size());
+    if (filterCapacity < 64)
+    {
+        filterCapacity = 64;
+    }
+
+    long long blocks = (filterCapacity * filterBitsPerKey + 255) / 256;
+    filterWords.assign(blocks * 8, 0);
+    filterEntries = 0;
+    filterRemoved = 0;
+    filterAddSubtree(root);
+    for (int i = 0; i < writeBuffer.size(); i++)
+    {
+        if (writeBuffer[i].isInsert)
+        {
+            filterMark(writeBuffer[i].key);
+        }
+    }
+}
+
+/*
+RefreshFilter rebuilds the membership filter once more keys have been added than it was sized for, or half as many removed. A rebuild
+costs O(n) and happens only after about n writes, so its cost is spread over them at O(1) each. DropFilter throws the filter away
+after an operation that would cost more to keep it exact, and sets it up to be rebuilt after as many writes as the tree holds keys, or
+half as many removes.
+
+@param[in]: Nothing.
+@return: The filter rebuilt if it was out of date, or dropped.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::refreshFilter()
+{
+    if (filterBitsPerKey > 0 && (filterEntries > filterCapacity || filterRemoved > filterCapacity / 2))
+    {
+        rebuildFilter();
+    }
+}
+
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::dropFilter()
+{
+    filterWords.clear();
+    filterCapacity = totalKeyCount < 64 ? 64 : totalKeyCount;
+    filterEntries = 0;
+    filterRemoved = 0;
+}
+
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::filterAddSubtree(BTreeNode* node)
+{
+    if (node == nullptr)
+    {
+        return;
+    }
+
+    for (int i = 0; i < node->keyVector.size(); i++)
+    {
+        filterAdd(node->keyVector[i]);
+    }
+    for (int i = 0; i < node->childrenVector.size(); i++)
+    {
+        filterAddSubtree(node->childrenVector[i]);
+    }
+}
+
+/*
+SetHugePageNodes switches where nodes are allocated. With it on, internal nodes and their vectors come from the hot BTreeArena and leaves
+from the cold one, both backed by 2MB huge pages, so the upper levels that every descent goes through are packed into a few pages. The
+nodes already in the tree are moved to the new placement one level at a time from root, which keeps each level together. Buffered writes
+and queued restructuring are left as they are, so a lazy tree is not compacted by the move. Turning it off moves them back to the heap. With numaNode set, internal nodes come from the
+hot arena of that NUMA node instead, for a tree mostly read from threads on that node.
+
+@param[in]: Whether nodes are placed in the huge page arenas, and the NUMA node for internal nodes, or -1 for any.
+@return: The B-Tree with every node in the new placement.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::setHugePageNodes(bool enabled, int numaNode)
+{
+    hugePageNodes = enabled;
+    hugePageNumaNode = numaNode;
+    finger = nullptr;
+    keyScratch = KeyVector(hugePageNodes ? &BTreeArena::cold() : nullptr);
+
+    if (root == nullptr)
+    {
+        return;
+    }
+
+    root = relocateNode(root);
+    vector<BTreeNode*> level(1, root);
+    while (!level.empty())
+    {
+        vector<BTreeNode*> nextLevel;
+        for (int i = 0; i < level.size(); i++)
+        {
+            BTreeNode* node = level[i];
+            for (int j = 0; j < node->childrenVector.size(); j++)
+            {
+                node->childrenVector[j] = relocateNode(node->childrenVector[j]);
+                nextLevel.push_back(node->childrenVector[j]);
+            }
+        }
+        level.swap(nextLevel);
+    }
+}
+
+/*
+RelocateNode moves a node's keys and child pointers into a new node allocated under the current placement, points its children at the new
+node, and deletes the old one. A node waiting in dirtyNodes or overflowNodes is replaced there by the new node. The caller replaces the
+pointer held by the parent.
+
+@param[in]: A node of the tree.
+@return: The new node.
+*/
+template <typename DATA_TYPE>
+typename BTree<DATA_TYPE>::BTreeNode* BTree<DATA_TYPE>::relocateNode(BTreeNode* node)
+{
+    BTreeNode* copy = newNode(node->childrenVector.empty());
+    copy->keyVector.assign(make_move_iterator(node->keyVector.begin()), make_move_iterator(node->keyVector.end()));
+    copy->childrenVector.assign(node->childrenVector.begin(), node->childrenVector.end());
+    copy->parent = node->parent;
+    copy->subtreeCount = node->subtreeCount;
+    copy->subtreeNodes = node->subtreeNodes;
+    copy->dirty = node->dirty;
+    copy->overflowQueued = node->overflowQueued;
+
+    if (node->dirty)
+    {
+        *std::find(dirtyNodes.begin(), dirtyNodes.end(), node) = copy;
+    }
+    if (node->overflowQueued)
+    {
+        *std::find(overflowNodes.begin(), overflowNodes.end(), node) = copy;
+    }
+    for (int i = 0; i < copy->childrenVector.size(); i++)
+    {
+        copy->childrenVector[i]->parent = copy;
+    }
+    if (rightmostLeaf == node)
+    {
+        rightmostLeaf = copy;
+    }
+
+    deleteNode(node);
+    return copy;
+}
+
+/*
+NewNode creates an empty node, in the hot arena if it will be internal and in the cold arena if it will be a leaf when hugePageNodes is
+set, and on the heap otherwise. A node never changes between leaf and internal, so the choice holds for its whole life. DeleteNode
+destroys a node and returns its memory to wherever it came from, after clearing the lookup cache entries that point at it, if it has any,
+so no entry is left pointing at freed memory. Entries for other nodes are kept.
+
+@param[in]: Whether the new node is a leaf, or the node to delete.
+@return: The new node, or nothing.
+*/
+template <typename DATA_TYPE>
+typename BTree<DATA_TYPE>::BTreeNode* BTree<DATA_TYPE>::newNode(bool isLeaf)
+{
+    if (!hugePageNodes)
+    {
+        return new BTreeNode(nullptr);
+    }
+
+    BTreeArena* arena = isLeaf ? &BTreeArena::cold() : &BTreeArena::hot(hugePageNumaNode);
+    return new (arena->allocate(sizeof(BTreeNode))) BTreeNode(arena);
+}
+
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::deleteNode(BTreeNode* node)
+{
+    for (int i = 0; node->cachedLookups > 0 && i < lookupCache.size(); i++)
+    {
+        if (lookupCache[i].node == node)
+        {
+            dropLookup(lookupCache[i]);
+        }
+    }
+    BTreeArena* arena = node->arena;
+    if (arena == nullptr)
+    {
+        delete node;
+        return;
+    }
+
+    node->~BTreeNode();
+    arena->deallocate(node, sizeof(BTreeNode));
+}
+
+/*
+SetLookupCache turns the lookup cache on or off. With slots above 0, search, searchNear and contains keep a direct mapped table of that
+many entries, rounded up to a power of two, from keys hashed with hash to the node and index each key was last found at. A lookup whose
+key is still at its entry returns without descending the tree, which pays off when reads keep coming back to the same keys, and costs a
+hash and one table read otherwise. While fewer than 1 in 16 probes hit, as with uniform reads, only 1 lookup in 64 probes the cache, which
+keeps that cost small until hot keys come back. At 16 bytes per entry, a few thousand slots stay in the CPU caches. Remove clears the
+entry of its key, deleting a node clears the entries pointing at it, and handing nodes to another tree through join or splitAt clears
+every entry. A key with a
+buffered write is answered from the write buffer before the cache is probed. A slots value of 0 turns the cache off and frees it.
+
+@param[in]: The number of cache entries, or 0 to turn the cache off, and a hash function for the keys.
+@return: The B-Tree with an empty lookup cache of the new size.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::setLookupCache(int slots, size_t (*hash)(const DATA_TYPE& item))
+{
+    if (hash != nullptr)
+    {
+        hashItem = hash;
+    }
+
+    int size = 0;
+    if (slots > 0 && hashItem != nullptr)
+    {
+        size = 1;
+        while (size < slots)
+        {
+            size *= 2;
+        }
+    }
+
+    invalidateLookups();
+    BTreeCacheEntry empty = { nullptr, 0, 0 };
+    lookupCache.assign(size, empty);
+    lookupCache.shrink_to_fit();
+    cacheStride = 1;
+    cacheCountdown = 1;
+    cacheProbes = 0;
+    cacheHitsSeen = 0;
+}
+
+/*
+CacheEntry returns the lookup cache entry that a key with the given hash maps to. The cache must be on.
+
+@param[in]: The filterHash of a key.
+@return: The entry for the key, which may hold another key or be out of date.
+*/
+template <typename DATA_TYPE>
+typename BTree<DATA_TYPE>::BTreeCacheEntry& BTree<DATA_TYPE>::cacheEntry(uint64_t hash)
+{
+    return lookupCache[hash & (lookupCache.size() - 1)];
+}
+
+/*
+DropLookup empties a lookup cache entry, and takes it off the count of entries pointing at its node. InvalidateLookups empties every entry,
+which is done before the tree's nodes are deleted together or handed to another tree, so that their counts only cover entries still in use.
+
+@param[in]: The entry to empty, or nothing.
+@return: The B-Tree with the entry, or every entry, empty.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::dropLookup(BTreeCacheEntry& entry)
+{
+    if (entry.node != nullptr)
+    {
+        entry.node->cachedLookups--;
+        entry.node = nullptr;
+    }
+}
+
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::invalidateLookups()
+{
+    for (int i = 0; i < lookupCache.size(); i++)
+    {
+        dropLookup(lookupCache[i]);
+    }
+}
+
+/*
+SampleCache records whether a lookup cache probe hit, and every 256 probes sets the probe stride from the hit rate: every lookup probes
+while at least 1 in 16 probes hit, and 1 lookup in 64 otherwise.
+
+@param[in]: Whether the probe hit.
+@return: The B-Tree with the probe stride updated.
+*/
+template <typename DATA_TYPE>
+void BTree<DATA_TYPE>::sampleCache(bool hit)
+{
+    cacheHitsSeen += hit;
+    if (++cacheProbes == 256)
+    {
+        cacheStride = cacheHitsSeen * 16 < cacheProbes ? 64 : 1;
+        cacheProbes = 0;
+        cacheHitsSeen = 0;
     }
 }
\ No newline at end of file
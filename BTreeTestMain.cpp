@@ -0,0 +1,493 @@
+/*
+@filename: BTree - Test Main
+
+@author: Doc Holloway
+@date: 10/18/2026
+
+@description: This test main checks the B-Tree against std::set under every combination of its optional modes: lazy rebalancing,
+incremental restructuring, buffered writes, the membership filter, huge page nodes and the lookup cache, with plain and finger calls
+mixed in every run. Each of the 64 combinations runs the same seeded sequence of random inserts, removes and searches, including the
+exceptions each one should or should not throw, and regularly compares count, rank, select, countRange and scan, splitAt and join, and
+union, intersection and difference against the same operations on std::set. Keys are 64 bytes wide, so nodes hold 8 keys and the trees
+grow several levels deep on a few thousand keys. Every mismatch is printed, and the exit code is the number of combinations that failed.
+
+Usage:
+	BTreeTests [seed]
+	seed  Seed for the random sequence (default 1).
+
+Compilation instructions:
+
+Using Ubuntu 22.04:
+	g++ -O1 -g -fsanitize=address,undefined BTreeTestMain.cpp -o BTreeTests
+	./BTreeTests
+Using Visual Studio:
+	Build BTreeTestMain.cpp in place of the driver main with Address Sanitizer on, and run with the local Windows Debugger
+*/
+
+#include "BTreeTemplateClass.h"
+#include <set>
+#include <cstdlib>
+
+/*
+Wide key holds an int value padded out to 64 bytes. Only value takes part in comparisons and hashing.
+*/
+struct WideKey
+{
+	int value;
+	char padding[60];
+
+	WideKey(int keyValue = 0) : value(keyValue), padding() {}
+
+	bool operator<(const WideKey& other) const { return value < other.value; }
+	bool operator>(const WideKey& other) const { return value > other.value; }
+	bool operator<=(const WideKey& other) const { return value <= other.value; }
+	bool operator>=(const WideKey& other) const { return value >= other.value; }
+	bool operator==(const WideKey& other) const { return value == other.value; }
+	bool operator!=(const WideKey& other) const { return value != other.value; }
+};
+
+/*
+Compare function used as pointer parameter in tree construction, and hash function used by the membership filter and the lookup cache.
+
+@param[in]: Two keys to be compared, or one key to be hashed.
+@return: -1, 0, or 1 based on the comparison of the inputs, or the hash of the key.
+*/
+int compareKeys(const WideKey& item1, const WideKey& item2)
+{
+	if (item1 < item2)
+		return -1;
+	if (item1 == item2)
+		return 0;
+	return 1;
+}
+
+size_t hashKey(const WideKey& item)
+{
+	return static_cast<size_t>(item.value);
+}
+
+//Mode bits of a test run. A run with no bits set is a plain tree.
+const int lazyMode = 1;
+const int incrementalMode = 2;
+const int bufferedMode = 4;
+const int filterMode = 8;
+const int hugePageMode = 16;
+const int cacheMode = 32;
+const int modeCount = 64;
+
+const int keySpace = 3000;
+const int operationsPerRun = 6000;
+
+static int runFailures = 0;
+
+/*
+ModeName spells out the modes of a run, such as lazy+buffered, or plain when none is set.
+
+@param[in]: The mode bits of the run.
+@return: The names of the modes joined by +.
+*/
+string modeName(int modes)
+{
+	static const char* names[] = { "lazy", "incremental", "buffered", "filter", "hugepage", "cache" };
+	string name;
+	for (int i = 0; i < 6; i++)
+	{
+		if (modes & (1 << i))
+		{
+			name += (name.empty() ? "" : "+") + string(names[i]);
+		}
+	}
+	return name.empty() ? "plain" : name;
+}
+
+/*
+Check prints a failure message for the current run when condition does not hold. Only the first few failures of a run are printed.
+
+@param[in]: The condition that must hold, a description of what was checked, and the mode bits of the run.
+@return: Nothing. The run's failure count goes up when condition is false.
+*/
+void check(bool condition, const string& what, int modes)
+{
+	if (condition)
+	{
+		return;
+	}
+	if (runFailures < 5)
+	{
+		cout << "Failed: " << what << " (" << modeName(modes) << ")" << endl;
+	}
+	runFailures++;
+}
+
+/*
+ApplyModes switches on every mode of a run on a fresh tree, the same way for the tree under test and for the trees it is split into or
+combined with.
+
+@param[in]: A tree, and the mode bits to apply to it.
+@return: The tree with the modes on.
+*/
+void applyModes(BTree<WideKey>& tree, int modes)
+{
+	if (modes & lazyMode)
+	{
+		tree.setLazyRebalance(true, 2);
+	}
+	if (modes & incrementalMode)
+	{
+		tree.setIncrementalRestructure(2);
+	}
+	if (modes & bufferedMode)
+	{
+		tree.setWriteBuffer(4);
+	}
+	if (modes & filterMode)
+	{
+		tree.setMembershipFilter(10, hashKey);
+	}
+	if (modes & hugePageMode)
+	{
+		tree.setHugePageNodes(true);
+	}
+	if (modes & cacheMode)
+	{
+		tree.setLookupCache(256, hashKey);
+	}
+}
+
+/*
+CheckSearch looks key up through search or searchNear, and checks that a present key is returned and a missing one throws
+ItemNotFoundException, and that contains or containsNear agrees.
+
+@param[in]: The tree, its reference set, the key, whether to go through the finger, and the mode bits.
+@return: Nothing. Mismatches are reported through check.
+*/
+void checkSearch(BTree<WideKey>& tree, const set<int>& reference, int key, bool nearFinger, int modes)
+{
+	bool found = false;
+	try
+	{
+		WideKey result = nearFinger ? tree.searchNear(WideKey(key)) : tree.search(WideKey(key));
+		found = result.value == key;
+	}
+	catch (ItemNotFoundException& e)
+	{
+		found = false;
+	}
+	check(found == (reference.count(key) > 0), "search " + to_string(key), modes);
+
+	bool contained = nearFinger ? tree.containsNear(WideKey(key)) : tree.contains(WideKey(key));
+	check(contained == (reference.count(key) > 0), "contains " + to_string(key), modes);
+}
+
+/*
+CheckContents compares every key of the tree against reference through count, select, rank, contains, countRange and scan, and checks
+that select throws past either end.
+
+@param[in]: The tree, the set it should match, a label for the failure message, and the mode bits of the run.
+@return: Nothing. Mismatches are reported through check.
+*/
+void checkContents(BTree<WideKey>& tree, const set<int>& reference, const string& label, int modes)
+{
+	int size = reference.size();
+	check(tree.count() == size, label + ": count", modes);
+
+	int index = 0;
+	for (set<int>::const_iterator it = reference.begin(); it != reference.end() && tree.count() == size; ++it, index++)
+	{
+		if (tree.select(index).value != *it || tree.rank(WideKey(*it)) != index)
+		{
+			check(false, label + ": select or rank of " + to_string(*it), modes);
+			break;
+		}
+	}
+
+	for (int key = -1; key <= keySpace; key += 7)
+	{
+		check(tree.contains(WideKey(key)) == (reference.count(key) > 0), label + ": contains " + to_string(key), modes);
+	}
+
+	for (int i = 0; i < 20; i++)
+	{
+		int low = rand() % keySpace;
+		int high = low + rand() % (keySpace / 4);
+		int expected = distance(reference.lower_bound(low), reference.upper_bound(high));
+		check(tree.countRange(WideKey(low), WideKey(high)) == expected, label + ": countRange", modes);
+	}
+
+	vector<WideKey> scanned;
+	for (int i = 0; i < 5; i++)
+	{
+		int low = rand() % keySpace;
+		int limit = rand() % 50;
+		tree.scan(WideKey(low), limit, scanned);
+		set<int>::const_iterator it = reference.lower_bound(low);
+		bool matches = true;
+		for (size_t k = 0; k < scanned.size(); k++, ++it)
+		{
+			matches = matches && it != reference.end() && scanned[k].value == *it;
+		}
+		int expected = min(limit, static_cast<int>(distance(reference.lower_bound(low), reference.end())));
+		check(matches && static_cast<int>(scanned.size()) == expected, label + ": scan from " + to_string(low), modes);
+	}
+
+	int throws = 0;
+	try
+	{
+		tree.select(-1);
+	}
+	catch (ItemNotFoundException& e)
+	{
+		throws++;
+	}
+	try
+	{
+		tree.select(size);
+	}
+	catch (ItemNotFoundException& e)
+	{
+		throws++;
+	}
+	check(throws == 2, label + ": select out of range", modes);
+}
+
+/*
+CheckWrite inserts or removes key, through the finger when nearFinger is set, and checks that it throws exactly when it should. Outside
+buffered mode, a duplicate insert throws DuplicateItemException, a remove from an empty tree TreeEmptyException and a remove of a missing
+key ItemNotFoundException. Buffered writes never throw.
+
+@param[in]: The tree, its reference set, the key, whether to insert or remove, whether to go through the finger, and the mode bits.
+@return: The tree and reference set with the write applied.
+*/
+void checkWrite(BTree<WideKey>& tree, set<int>& reference, int key, bool isInsert, bool nearFinger, int modes)
+{
+	bool buffered = (modes & bufferedMode) != 0;
+	bool present = reference.count(key) > 0;
+	string thrown;
+
+	try
+	{
+		if (isInsert)
+		{
+			nearFinger ? tree.insertNear(WideKey(key)) : tree.insert(WideKey(key));
+		}
+		else
+		{
+			nearFinger ? tree.removeNear(WideKey(key)) : tree.remove(WideKey(key));
+		}
+	}
+	catch (DuplicateItemException& e)
+	{
+		thrown = "duplicate";
+	}
+	catch (TreeEmptyException& e)
+	{
+		thrown = "empty";
+	}
+	catch (ItemNotFoundException& e)
+	{
+		thrown = "not found";
+	}
+
+	string expected;
+	if (!buffered && isInsert && present)
+	{
+		expected = "duplicate";
+	}
+	else if (!buffered && !isInsert && !present)
+	{
+		expected = reference.empty() ? "empty" : "not found";
+	}
+	check(thrown == expected, string(isInsert ? "insert " : "remove ") + to_string(key) + " threw '" + thrown + "'", modes);
+
+	if (isInsert)
+	{
+		reference.insert(key);
+	}
+	else
+	{
+		reference.erase(key);
+	}
+}
+
+/*
+CheckSplitJoin splits the tree at a random key into a second tree, checks both halves, and joins them back, taking turns between the
+O(log n) join of a larger tree, the linear join of overlapping trees and the join into an empty tree.
+
+@param[in]: The tree, its reference set, the number of the step, and the mode bits.
+@return: The tree holding the same keys as before.
+*/
+void checkSplitJoin(BTree<WideKey>& tree, set<int>& reference, int step, int modes)
+{
+	int key = rand() % keySpace;
+	BTree<WideKey> right(compareKeys);
+	applyModes(right, modes);
+	tree.splitAt(WideKey(key), right);
+
+	set<int> leftKeys(reference.begin(), reference.lower_bound(key));
+	set<int> rightKeys(reference.lower_bound(key), reference.end());
+	checkContents(tree, leftKeys, "splitAt left part", modes);
+	checkContents(right, rightKeys, "splitAt right part", modes);
+
+	if (step % 2 == 0)
+	{
+		tree.join(right);
+	}
+	else
+	{
+		right.join(tree);
+		checkContents(tree, set<int>(), "join leaves other empty", modes);
+		tree.join(right);
+	}
+	checkContents(tree, reference, "join", modes);
+	checkContents(right, set<int>(), "join leaves other empty", modes);
+}
+
+/*
+CheckSetOperation combines the tree with a random second tree through unionWith, intersectWith or differenceWith in turn, and checks the
+result and that the second tree is left unchanged.
+
+@param[in]: The tree, its reference set, the number of the step, and the mode bits.
+@return: The tree holding the result of the operation.
+*/
+void checkSetOperation(BTree<WideKey>& tree, set<int>& reference, int step, int modes)
+{
+	BTree<WideKey> other(compareKeys);
+	applyModes(other, modes);
+	set<int> otherKeys;
+	int low = rand() % keySpace;
+	for (int i = 0; i < keySpace / 3; i++)
+	{
+		int key = (low + rand() % (keySpace / 2)) % keySpace;
+		if (otherKeys.insert(key).second)
+		{
+			other.insert(WideKey(key));
+		}
+	}
+
+	set<int> result;
+	string label;
+	if (step % 3 == 0)
+	{
+		label = "unionWith";
+		tree.unionWith(other);
+		result = reference;
+		result.insert(otherKeys.begin(), otherKeys.end());
+	}
+	else if (step % 3 == 1)
+	{
+		label = "intersectWith";
+		tree.intersectWith(other);
+		for (set<int>::iterator it = reference.begin(); it != reference.end(); ++it)
+		{
+			if (otherKeys.count(*it) > 0)
+			{
+				result.insert(*it);
+			}
+		}
+	}
+	else
+	{
+		label = "differenceWith";
+		tree.differenceWith(other);
+		for (set<int>::iterator it = reference.begin(); it != reference.end(); ++it)
+		{
+			if (otherKeys.count(*it) == 0)
+			{
+				result.insert(*it);
+			}
+		}
+	}
+
+	reference = result;
+	checkContents(tree, reference, label, modes);
+	checkContents(other, otherKeys, label + " leaves other unchanged", modes);
+}
+
+/*
+RunModes drives one combination of modes through the seeded sequence of operations, and checks the tree against std::set as it goes.
+
+@param[in]: The mode bits of the run, and the seed.
+@return: The number of failed checks.
+*/
+int runModes(int modes, unsigned seed)
+{
+	srand(seed);
+	runFailures = 0;
+
+	BTree<WideKey> tree(compareKeys);
+	applyModes(tree, modes);
+	set<int> reference;
+
+	for (int step = 1; step <= operationsPerRun; step++)
+	{
+		int key = rand() % keySpace;
+		bool nearFinger = rand() % 2 == 0;
+		int choice = rand() % 10;
+		if (choice < 4)
+		{
+			checkWrite(tree, reference, key, true, nearFinger, modes);
+		}
+		else if (choice < 7)
+		{
+			checkWrite(tree, reference, key, false, nearFinger, modes);
+		}
+		else
+		{
+			checkSearch(tree, reference, key, nearFinger, modes);
+		}
+
+		if ((modes & lazyMode) && step % 250 == 0)
+		{
+			tree.compact(rand() % 4);
+		}
+		if (step % 500 == 0)
+		{
+			checkContents(tree, reference, "after " + to_string(step) + " operations", modes);
+		}
+		if (step % 1000 == 0)
+		{
+			checkSplitJoin(tree, reference, step / 1000, modes);
+		}
+		if (step % 1500 == 0)
+		{
+			checkSetOperation(tree, reference, step / 1500, modes);
+		}
+	}
+
+	while (!reference.empty())
+	{
+		checkWrite(tree, reference, *reference.begin(), false, false, modes);
+	}
+	checkContents(tree, reference, "after removing every key", modes);
+
+	return runFailures;
+}
+
+/*
+Main function runs every combination of modes with the same seed, and reports each one as passed or failed.
+
+@param[in]: An optional seed.
+@return: The number of combinations that failed.
+*/
+int main(int argc, char* argv[])
+{
+	unsigned seed = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], nullptr, 10)) : 1;
+	int failedRuns = 0;
+
+	for (int modes = 0; modes < modeCount; modes++)
+	{
+		int failures = runModes(modes, seed);
+		if (failures == 0)
+		{
+			cout << "Passed " << modeName(modes) << endl;
+		}
+		else
+		{
+			cout << "Failed " << modeName(modes) << ": " << failures << " checks" << endl;
+			failedRuns++;
+		}
+	}
+
+	cout << failedRuns << " of " << modeCount << " mode combinations failed with seed " << seed << endl;
+	return failedRuns;
+}
\ No newline at end of file